@@ -0,0 +1,73 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mem.h"
+#include "mem_handle.h"
+#include "util.h"
+
+#define HEAP_INIT_SIZE (1 << 16) // Начальный размер кучи
+#define LIVE 4096                // Кол-во одновременно живых блоков
+#define ROUNDS 40                // Кол-во раундов фрагментирующей нагрузки
+#define STEP_BUDGET_NS 50000     // Ограничение времени шага уплотнения
+#define SEED 11                  // Зерно генератора для повторяемой нагрузки
+
+
+/**
+ * @brief Фрагментирующая нагрузка: в каждом раунде куча заполняется блоками случайного размера,
+ *        после чего освобождаются примерно три четверти из них
+ * @param[in] name Название режима
+ * @param[in] compact Флаг уплотнения между раундами
+*/
+static void run( const char* name, bool compact )
+{
+  static hnd_t live[LIVE];
+
+  void* heap = heap_init(HEAP_INIT_SIZE);
+  if (!heap)
+    err("Не удалось инициализировать кучу\n");
+
+  srand(SEED);
+  size_t peak = 0;
+  for (size_t round = 0; round < ROUNDS; ++round)
+  {
+    for (size_t i = 0; i < LIVE; ++i) // Заполнение освобождённых мест блоками случайного размера
+      if (hnd_is_invalid(live[i]))
+      {
+        live[i] = hnd_alloc(16 + (size_t) rand() % 256);
+        if (hnd_is_invalid(live[i]))
+          err("Не удалось выделить память\n");
+      }
+
+    const size_t mapped = heap_mapped_bytes();
+    peak = mapped > peak ? mapped : peak;
+
+    for (size_t i = 0; i < LIVE; ++i) // Выживает примерно четверть блоков, вразброс по куче
+      if (rand() % 4)
+      {
+        hnd_free(live[i]);
+        live[i] = HND_INVALID;
+      }
+
+    if (compact) // Несколько ограниченных по времени шагов между раундами
+      for (size_t step = 0; step < 8 && !hnd_compact_step(STEP_BUDGET_NS); ++step);
+  }
+
+  printf("%-12s пик %10zu байт, в конце %10zu байт\n", name, peak, heap_mapped_bytes());
+
+  for (size_t i = 0; i < LIVE; ++i)
+  {
+    hnd_free(live[i]);
+    live[i] = HND_INVALID;
+  }
+  heap_kill(heap, HEAP_INIT_SIZE);
+}
+
+int main()
+{
+  run("no compact", false);
+  run("compact", true);
+
+  return 0;
+}
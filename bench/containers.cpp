@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+#include "mem.hpp"
+
+#define ITEMS 10000  // Кол-во элементов в контейнере
+#define ROUNDS 5     // Кол-во повторов замера
+
+
+/**
+ * @brief Замер времени выполнения нагрузки
+ * @param[in] name Название замера
+ * @param[in] work Нагрузка
+*/
+static void measure(const char* name, const std::function<void()>& work)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; ++i)
+    work();
+  const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  std::printf("%-36s %10lld мкс\n", name, static_cast<long long>(elapsed.count()) / ROUNDS);
+}
+
+/**
+ * @brief Наполнение вектора по одному элементу
+*/
+template <class Vector>
+static void vector_work(Vector&& v)
+{
+  for (int i = 0; i < ITEMS; ++i)
+    v.push_back(i);
+}
+
+/**
+ * @brief Вставка и удаление половины ключей в ассоциативном контейнере
+*/
+template <class Map>
+static void map_work(Map&& m)
+{
+  for (int i = 0; i < ITEMS; ++i)
+    m.emplace(i * 7919 % ITEMS, i);
+  for (int i = 0; i < ITEMS; i += 2)
+    m.erase(i);
+}
+
+int main()
+{
+  std::pmr::memory_resource* heap = mem::heap_memory_resource();
+
+  measure("vector / std::allocator", [] { vector_work(std::vector<int>()); });
+  measure("vector / mem::allocator", [] { vector_work(std::vector<int, mem::allocator<int>>()); });
+  measure("vector / mem::heap_resource", [heap] { vector_work(std::pmr::vector<int>(heap)); });
+
+  measure("map / std::allocator", [] { map_work(std::map<int, int>()); });
+  measure("map / mem::allocator", [] {
+    map_work(std::map<int, int, std::less<int>, mem::allocator<std::pair<const int, int>>>());
+  });
+  measure("map / mem::heap_resource", [heap] { map_work(std::pmr::map<int, int>(heap)); });
+
+  measure("unordered_map / std::allocator", [] { map_work(std::unordered_map<int, int>()); });
+  measure("unordered_map / mem::allocator", [] {
+    map_work(std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                                mem::allocator<std::pair<const int, int>>>());
+  });
+  measure("unordered_map / mem::heap_resource", [heap] { map_work(std::pmr::unordered_map<int, int>(heap)); });
+
+  return 0;
+}
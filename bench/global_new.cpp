@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <new>
+#include <vector>
+
+#define MEM_REPLACE_GLOBAL_NEW
+#include "mem.hpp"
+
+#define ITEMS 10000           // Кол-во элементов в контейнере
+#define ROUNDS 5              // Кол-во повторов замера
+#define RESERVE_SIZE (8 << 20) // Размер запаса памяти, освобождаемого обработчиком new_handler
+
+
+static char* reserve = nullptr;   // Запас памяти для обработчика
+static int handler_calls = 0;     // Кол-во вызовов обработчика
+
+/**
+ * @brief Замер времени выполнения нагрузки
+ * @param[in] name Название замера
+ * @param[in] work Нагрузка
+*/
+static void measure(const char* name, const std::function<void()>& work)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; ++i)
+    work();
+  const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  std::printf("%-36s %10lld мкс\n", name, static_cast<long long>(elapsed.count()) / ROUNDS);
+}
+
+/**
+ * @brief Обработчик нехватки памяти: освобождает запас и снимает себя
+*/
+static void release_reserve()
+{
+  ++handler_calls;
+  delete[] reserve;
+  reserve = nullptr;
+  std::set_new_handler(nullptr);
+}
+
+int main()
+{
+  measure("vector / global operator new", [] {
+    std::vector<int> v;
+    for (int i = 0; i < ITEMS; ++i)
+      v.push_back(i);
+  });
+  measure("map / global operator new", [] {
+    std::map<int, int> m;
+    for (int i = 0; i < ITEMS; ++i)
+      m.emplace(i * 7919 % ITEMS, i);
+    for (int i = 0; i < ITEMS; i += 2)
+      m.erase(i);
+  });
+
+  // Под жестким лимитом запрос проходит только после того, как обработчик вернет запас
+  reserve = new char[RESERVE_SIZE];
+  heap_set_limits(0, heap_mapped_bytes());
+  std::set_new_handler(release_reserve);
+  char* block = new char[RESERVE_SIZE];
+  heap_set_limits(0, 0);
+  std::printf("%-36s %10d\n", "new_handler / вызовов", handler_calls);
+  delete[] block;
+
+  return handler_calls == 1 ? 0 : 1;
+}
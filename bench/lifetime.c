@@ -0,0 +1,65 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mem.h"
+#include "util.h"
+
+#define HEAP_INIT_SIZE (1 << 16) // Начальный размер кучи
+#define STEPS 5000               // Кол-во шагов воспроизведения
+#define INFLIGHT 16              // Кол-во одновременно живых буферов запросов
+#define SEED 7                   // Зерно генератора для повторяемой нагрузки
+
+
+/**
+ * @brief Воспроизведение смешанной нагрузки: долгоживущие узлы индекса вперемешку с буферами запросов
+ * @param[in] name Название режима
+ * @param[in] hinted Флаг использования подсказок о времени жизни
+*/
+static void run( const char* name, bool hinted )
+{
+  static void* nodes[STEPS];
+  static void* buffers[INFLIGHT];
+
+  void* heap = heap_init(HEAP_INIT_SIZE);
+  if (!heap)
+    err("Не удалось инициализировать кучу\n");
+
+  srand(SEED);
+  size_t peak = 0;
+  for (size_t i = 0; i < STEPS; ++i)
+  {
+    const size_t slot = i % INFLIGHT;
+    _free(buffers[slot]); // Буфер живет INFLIGHT шагов
+    const size_t buffer_size = 16 * 1024 + (size_t) rand() % (48 * 1024);
+    buffers[slot] = hinted ? _malloc_ex(buffer_size, MEM_HINT_SHORT_LIVED) : _malloc(buffer_size);
+
+    const size_t node_size = 48 + (size_t) rand() % 80;
+    nodes[i] = hinted ? _malloc_ex(node_size, MEM_HINT_LONG_LIVED) : _malloc(node_size);
+    if (!buffers[slot] || !nodes[i])
+      err("Не удалось выделить память\n");
+
+    const size_t mapped = heap_mapped_bytes();
+    peak = mapped > peak ? mapped : peak;
+  }
+
+  printf("%-10s пик отображенной памяти %10zu байт\n", name, peak);
+
+  for (size_t i = 0; i < INFLIGHT; ++i)
+  {
+    _free(buffers[i]);
+    buffers[i] = NULL;
+  }
+  for (size_t i = 0; i < STEPS; ++i)
+    _free(nodes[i]);
+  heap_kill(heap, HEAP_INIT_SIZE);
+}
+
+int main()
+{
+  run("unhinted", false);
+  run("hinted", true);
+
+  return 0;
+}
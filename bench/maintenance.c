@@ -0,0 +1,86 @@
+#define _DEFAULT_SOURCE
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mem.h"
+#include "mem_maintenance.h"
+#include "util.h"
+
+#define HEAP_INIT_SIZE (1 << 20) // Начальный размер кучи
+#define SLOTS 4096               // Кол-во одновременно живых блоков
+#define OPS 200000               // Кол-во операций в замере
+#define MAX_QUERY 512            // Максимальный запрашиваемый размер
+#define SEED 42                  // Зерно генератора для повторяемой нагрузки
+
+
+/**
+ * @brief Текущее время в наносекундах
+ * @return Время в наносекундах
+*/
+static uint64_t now_ns( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief Сравнение задержек для qsort
+*/
+static int cmp_latency( const void* a, const void* b )
+{
+  const uint64_t x = *(const uint64_t*) a;
+  const uint64_t y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Замер задержек смешанной нагрузки _malloc/_free
+ * @param[in] name Название режима
+ * @param[in] background Флаг фонового обслуживания
+*/
+static void run( const char* name, bool background )
+{
+  static void* slots[SLOTS];
+  static uint64_t latency[OPS];
+
+  void* heap = heap_init(HEAP_INIT_SIZE);
+  if (!heap)
+    err("Не удалось инициализировать кучу\n");
+  if (background && !maintenance_start(NULL))
+    err("Не удалось запустить фоновое обслуживание\n");
+
+  memset(slots, 0, sizeof(slots));
+  srand(SEED);
+  for (size_t i = 0; i < OPS; ++i) // Каждая операция освобождает случайный слот и занимает его заново
+  {
+    const size_t slot = (size_t) rand() % SLOTS;
+    const size_t query = 1 + (size_t) rand() % MAX_QUERY;
+    const uint64_t start = now_ns();
+    _free(slots[slot]);
+    slots[slot] = _malloc(query);
+    latency[i] = now_ns() - start;
+  }
+
+  if (background)
+    maintenance_stop();
+  for (size_t i = 0; i < SLOTS; ++i)
+    _free(slots[i]);
+  heap_kill(heap, HEAP_INIT_SIZE);
+
+  qsort(latency, OPS, sizeof(latency[0]), cmp_latency);
+  printf("%-12s p50 %6" PRIu64 " нс  p99 %8" PRIu64 " нс  p99.9 %8" PRIu64 " нс  max %10" PRIu64 " нс\n",
+         name, latency[OPS / 2], latency[OPS * 99 / 100], latency[OPS * 999 / 1000], latency[OPS - 1]);
+}
+
+int main()
+{
+  run("foreground", false);
+  run("background", true);
+
+  return 0;
+}
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mem.h"
+
+#define SHIM_HEAP_SIZE (1 << 20)  // Начальный размер кучи
+#define SHIM_ALIGNMENT 16         // Выравнивание, которое ожидают программы от malloc
+#define BOOTSTRAP_SIZE (64 * 1024) // Размер статического буфера на время инициализации кучи
+
+#define SHIM_EXPORT __attribute__((visibility("default"))) // Экспорт символа из библиотеки
+
+
+/**
+ * @brief Состояние кучи библиотеки
+*/
+enum shim_state { SHIM_UNINIT, SHIM_INITIALIZING, SHIM_READY, SHIM_FAILED };
+
+static int shim_state = SHIM_UNINIT; // Текущее состояние кучи
+static __thread bool shim_in_init __attribute__((tls_model("initial-exec"))); // Поток находится внутри инициализации
+
+static alignas(SHIM_ALIGNMENT) uint8_t bootstrap[BOOTSTRAP_SIZE]; // Память для вызовов во время инициализации
+static size_t bootstrap_used = 0;                                 // Занятая часть буфера
+
+
+/**
+ * @brief Ленивая инициализация кучи при первом вызове
+ * @return true, если кучей можно пользоваться, иначе false
+*/
+static bool shim_ready( void )
+{
+  int state = __atomic_load_n(&shim_state, __ATOMIC_ACQUIRE);
+  if (state == SHIM_READY)
+    return true;
+  if (shim_in_init) // Повторный вход из инициализации обслуживается статическим буфером
+    return false;
+
+  int expected = SHIM_UNINIT;
+  if (__atomic_compare_exchange_n(&shim_state, &expected, SHIM_INITIALIZING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    shim_in_init = true;
+    void* heap = heap_init(SHIM_HEAP_SIZE);
+    shim_in_init = false;
+    state = heap == HEAP_START ? SHIM_READY : SHIM_FAILED; // Куча работает только с фиксированного адреса
+    __atomic_store_n(&shim_state, state, __ATOMIC_RELEASE);
+    if (state == SHIM_READY) // Куча не должна остаться захваченной в дочернем процессе чужим потоком
+      pthread_atfork(heap_lock, heap_unlock, heap_unlock);
+    return state == SHIM_READY;
+  }
+
+  while ((state = __atomic_load_n(&shim_state, __ATOMIC_ACQUIRE)) == SHIM_INITIALIZING) // Ждем чужую инициализацию
+    sched_yield();
+  return state == SHIM_READY;
+}
+
+/**
+ * @brief Проверка принадлежности указателя статическому буферу
+ * @param[in] ptr Указатель на данные
+ * @return true, если память выделена из буфера, иначе false
+*/
+static bool is_bootstrap( const void* ptr )
+{
+  return (const uint8_t*) ptr >= bootstrap && (const uint8_t*) ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+/**
+ * @brief Проверка того, что указатель выделен кучей
+ * @details Память, полученная в обход библиотеки (например, загрузчиком до ее подключения), куче не передается
+ * @param[in] ptr Указатель на данные
+ * @return true, если указатель принадлежит куче, иначе false
+*/
+static bool is_heap( const void* ptr )
+{
+  return __atomic_load_n(&shim_state, __ATOMIC_ACQUIRE) == SHIM_READY && heap_owns(ptr);
+}
+
+/**
+ * @brief Выделение памяти из статического буфера (память не возвращается)
+ * @param[in] size Запрашиваемый размер в байтах
+ * @param[in] alignment Выравнивание (степень двойки)
+ * @return Указатель на данные или NULL
+*/
+static void* bootstrap_alloc( size_t size, size_t alignment )
+{
+  alignment = alignment < SHIM_ALIGNMENT ? SHIM_ALIGNMENT : alignment;
+  // Перед данными хранится их размер для realloc и malloc_usable_size
+  size_t start = __atomic_load_n(&bootstrap_used, __ATOMIC_RELAXED);
+  size_t data, end;
+  do
+  {
+    data = (start + sizeof(size_t) + alignment - 1) & ~(alignment - 1);
+    end = data + size;
+    if (end > BOOTSTRAP_SIZE || end < data)
+      return NULL;
+  } while (!__atomic_compare_exchange_n(&bootstrap_used, &start, end, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  memcpy(bootstrap + data - sizeof(size_t), &size, sizeof(size_t));
+  return bootstrap + data;
+}
+
+/**
+ * @brief Размер данных, выделенных из статического буфера
+ * @param[in] ptr Указатель на данные
+ * @return Размер в байтах
+*/
+static size_t bootstrap_size( const void* ptr )
+{
+  size_t size;
+  memcpy(&size, (const uint8_t*) ptr - sizeof(size_t), sizeof(size_t));
+  return size;
+}
+
+/**
+ * @brief Выделение выровненной памяти с установкой errno
+ * @param[in] alignment Выравнивание (степень двойки)
+ * @param[in] size Запрашиваемый размер в байтах
+ * @return Указатель на данные или NULL
+*/
+static void* shim_alloc( size_t alignment, size_t size )
+{
+  void* ptr = shim_ready() ? _malloc_aligned(alignment, size) : bootstrap_alloc(size, alignment);
+  if (!ptr)
+    errno = ENOMEM;
+  return ptr;
+}
+
+SHIM_EXPORT void* malloc( size_t size ) { return shim_alloc(SHIM_ALIGNMENT, size); }
+
+SHIM_EXPORT void free( void* ptr )
+{
+  if (ptr && !is_bootstrap(ptr) && is_heap(ptr)) // Чужие указатели отвергаются
+    _free(ptr);
+}
+
+SHIM_EXPORT void* calloc( size_t nmemb, size_t size )
+{
+  void* ptr;
+  if (shim_ready())
+    ptr = _calloc_aligned(SHIM_ALIGNMENT, nmemb, size);
+  else // Статический буфер изначально заполнен нулями и не переиспользуется
+    ptr = (size && nmemb > SIZE_MAX / size) ? NULL : bootstrap_alloc(nmemb * size, SHIM_ALIGNMENT);
+  if (!ptr)
+    errno = ENOMEM;
+  return ptr;
+}
+
+SHIM_EXPORT size_t malloc_usable_size( void* ptr )
+{
+  if (!ptr)
+    return 0;
+  if (is_bootstrap(ptr))
+    return bootstrap_size(ptr);
+  return is_heap(ptr) ? _malloc_usable_size(ptr) : 0;
+}
+
+SHIM_EXPORT void* realloc( void* ptr, size_t size )
+{
+  if (!ptr)
+    return malloc(size);
+  if (!size)
+  {
+    free(ptr);
+    return NULL;
+  }
+
+  if (!is_bootstrap(ptr) && !is_heap(ptr)) // Размер чужого блока неизвестен: он остается нетронутым
+  {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  const size_t old_size = malloc_usable_size(ptr);
+  if (!is_bootstrap(ptr) && old_size >= size) // Данные помещаются в текущий блок
+    return ptr;
+
+  void* moved = malloc(size);
+  if (!moved)
+    return NULL;
+  memcpy(moved, ptr, old_size < size ? old_size : size);
+  free(ptr);
+  return moved;
+}
+
+SHIM_EXPORT int posix_memalign( void** memptr, size_t alignment, size_t size )
+{
+  if (!alignment || alignment % sizeof(void*) || (alignment & (alignment - 1))) // Выравнивание должно быть ненулевой степенью двойки, кратной sizeof(void*)
+    return EINVAL;
+  void* ptr = shim_alloc(alignment < SHIM_ALIGNMENT ? SHIM_ALIGNMENT : alignment, size);
+  if (!ptr)
+    return ENOMEM;
+  *memptr = ptr;
+  return 0;
+}
+
+SHIM_EXPORT void* aligned_alloc( size_t alignment, size_t size )
+{
+  if (!alignment || (alignment & (alignment - 1))) // Выравнивание должно быть степенью двойки
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+  return shim_alloc(alignment < SHIM_ALIGNMENT ? SHIM_ALIGNMENT : alignment, size);
+}
+
+SHIM_EXPORT void* memalign( size_t alignment, size_t size ) { return aligned_alloc(alignment, size); }
+
+SHIM_EXPORT void* __libc_memalign( size_t alignment, size_t size ) { return aligned_alloc(alignment, size); }
+
+SHIM_EXPORT void* valloc( size_t size ) { return shim_alloc(getpagesize(), size); }
+
+SHIM_EXPORT void* pvalloc( size_t size )
+{
+  const size_t page = getpagesize();
+  if (size > SIZE_MAX - page) // Переполнение при округлении до страницы
+  {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return shim_alloc(page, size ? (size + page - 1) & ~(page - 1) : page);
+}
+
+SHIM_EXPORT void* reallocarray( void* ptr, size_t nmemb, size_t size )
+{
+  if (size && nmemb > SIZE_MAX / size) // Переполнение при расчете размера
+  {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return realloc(ptr, nmemb * size);
+}
@@ -1,7 +1,11 @@
 #define _DEFAULT_SOURCE
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "mem_internals.h"
@@ -10,6 +14,34 @@
 
 #define NO_ADDITIONAL_FLAG 0 // Заглушка для дополнительного флага  при вызове mmap
 
+_Static_assert(HEAP_POOLS <= 1 << BLOCK_POOL_BITS, "Номер пула не помещается в заголовок блока");
+
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER; // Блокировка кучи
+static bool heap_ready = false;                                // Флаг инициализированной кучи
+static bool heap_deferred = false;                             // Флаг отложенного слияния блоков
+static void (*heap_pressure_hook)( void ) = NULL;              // Обработчик нехватки памяти в отложенном режиме
+static struct block_header* maintain_cursor = NULL;            // Блок, с которого продолжится обслуживание кучи
+static size_t maintain_pool = HEAP_POOL_DEFAULT;               // Пул, в котором продолжится обслуживание кучи
+static struct heap_pool_state heap_pools[HEAP_POOLS];          // Пулы кучи
+
+#define POOL_SPACING ((uintptr_t) 1 << 32) // Расстояние между желаемыми адресами начала пулов
+
+#define HEAP_PRESSURE_CALLBACKS 8 // Максимальное кол-во обработчиков превышения мягкого лимита
+
+static size_t heap_mapped = 0;     // Кол-во байт, отображенных под кучу
+static size_t heap_soft_limit = 0; // Мягкий лимит отображенной памяти (0 - нет лимита)
+static size_t heap_hard_limit = 0; // Жесткий лимит отображенной памяти (0 - нет лимита)
+static bool heap_pressure = false; // Флаг превышения лимита, ожидающего обработки
+static bool heap_limit_hit = false; // Жесткий лимит уже достигнут: повторные отказы не вызывают обработчики
+static struct { heap_pressure_callback cb; void* arg; } pressure_callbacks[HEAP_PRESSURE_CALLBACKS]; // Обработчики
+static size_t pressure_callbacks_count = 0; // Кол-во зарегистрированных обработчиков
+#define HEAP_RANGES 64 // Максимальное кол-во несмежных участков адресов, отображенных под кучу
+
+static struct { uintptr_t start; uintptr_t end; } heap_ranges[HEAP_RANGES]; // Участки адресов, отображенные под кучу
+static size_t heap_ranges_count = 0;                                        // Кол-во участков
+static __thread enum heap_error heap_error __attribute__((tls_model("initial-exec"))) = HEAP_OK; // Ошибка последнего выделения
+static __thread void (*pressure_hook_pending)( void ) __attribute__((tls_model("initial-exec"))) = NULL; // Обработчик, ожидающий снятия блокировки
+
 
 extern inline block_size size_from_capacity( block_capacity cap );
 extern inline block_capacity capacity_from_size( block_size sz );
@@ -32,9 +64,13 @@ static size_t pages_count( size_t mem ) { return mem / getpagesize() + ((mem % g
 /**
  * @brief Расчет общего кол-ва байт на все страницы
  * @param[in] mem Размер памяти в байтах
- * @return Кол-во байт суммарное 
+ * @return Кол-во байт суммарное или SIZE_MAX, если оно не помещается в size_t
 */ 
-static size_t round_pages( size_t mem ) { return getpagesize() * pages_count( mem ) ; }
+static size_t round_pages( size_t mem )
+{
+  size_t bytes;
+  return __builtin_mul_overflow(pages_count(mem), (size_t) getpagesize(), &bytes) ? SIZE_MAX : bytes;
+}
 
 /**
  * @brief Инициализация блока памяти по заданному адресу
@@ -51,6 +87,237 @@ static void block_init( void* restrict addr, block_size block_sz, void* restrict
   };
 }
 
+/**
+ * @brief Пул, которому принадлежит блок
+ * @param[in] block Указатель на структуру блока
+ * @return Указатель на состояние пула
+*/
+static struct heap_pool_state* block_pool( struct block_header const* block ) { return &heap_pools[block->pool]; }
+
+/**
+ * @brief Длина грязной части данных свободного блока за заданным смещением
+ * @param[in] block Указатель на структуру свободного блока
+ * @param[in] offset Смещение от начала данных блока в байтах
+ * @return Кол-во байт за смещением, которые могли быть изменены
+*/
+static size_t dirty_after( struct block_header const* block, size_t offset )
+{
+  return block->dirty_bytes > offset ? block->dirty_bytes - offset : 0;
+}
+
+/*  --- Сводка о свободных блоках --- */
+/**
+ * @brief Расчет класса размера: старший бит вместимости и INDEX_SUBCLASS_BITS следующих за ним
+ * @param[in] capacity Вместимость блока в байтах
+ * @return Номер класса, классы упорядочены по возрастанию вместимости
+*/
+static size_t size_class( size_t capacity )
+{
+  if (capacity < (1u << INDEX_SUBCLASS_BITS))
+    return 0;
+  const unsigned msb = 63 - __builtin_clzll(capacity);
+  const size_t sub = (capacity >> (msb - INDEX_SUBCLASS_BITS)) & ((1u << INDEX_SUBCLASS_BITS) - 1);
+  return ((size_t) msb << INDEX_SUBCLASS_BITS) | sub;
+}
+
+/**
+ * @brief Чтение связей свободного блока
+ * @param[in] block Указатель на структуру свободного блока
+ * @return Связи блока в списке его класса
+*/
+static struct free_links links_get( struct block_header const* block )
+{
+  struct free_links links;
+  memcpy(&links, block->contents + block->capacity.bytes - sizeof(links), sizeof(links)); // Конец данных не выровнен
+  return links;
+}
+
+/**
+ * @brief Запись связей свободного блока
+ * @param[out] block Указатель на структуру свободного блока
+ * @param[in] links Связи блока в списке его класса
+*/
+static void links_set( struct block_header* block, struct free_links links )
+{
+  memcpy(block->contents + block->capacity.bytes - sizeof(links), &links, sizeof(links));
+}
+
+/**
+ * @brief Учет свободного блока в сводке
+ * @details Блок становится первым в списке своего класса
+ * @param[out] block Указатель на структуру свободного блока
+*/
+static void index_add( struct block_header* block )
+{
+  struct free_index* const heap_index = &block_pool(block)->index;
+  const size_t cls = size_class(block->capacity.bytes);
+  struct block_header* const first = heap_index->lists[cls];
+  links_set(block, (struct free_links) {.prev = NULL, .next = first, .block = block});
+  if (first)
+  {
+    struct free_links links = links_get(first);
+    links.prev = block;
+    links_set(first, links);
+  }
+  else // Класс стал непустым
+  {
+    heap_index->words[cls / 64] |= UINT64_C(1) << (cls % 64);
+    heap_index->summary |= UINT64_C(1) << (cls / 64);
+  }
+  heap_index->lists[cls] = block;
+  heap_index->blocks++;
+  heap_index->bytes += block->capacity.bytes;
+}
+
+/**
+ * @brief Исключение свободного блока из сводки
+ * @details Связи блока обнуляются: за пределами грязной части данные блока снова состоят из нулей
+ * @param[out] block Указатель на структуру свободного блока
+*/
+static void index_remove( struct block_header* block )
+{
+  struct free_index* const heap_index = &block_pool(block)->index;
+  const size_t cls = size_class(block->capacity.bytes);
+  const struct free_links links = links_get(block);
+  if (links.prev)
+  {
+    struct free_links prev = links_get(links.prev);
+    prev.next = links.next;
+    links_set(links.prev, prev);
+  }
+  else
+    heap_index->lists[cls] = links.next;
+  if (links.next)
+  {
+    struct free_links next = links_get(links.next);
+    next.prev = links.prev;
+    links_set(links.next, next);
+  }
+  if (!heap_index->lists[cls]) // Класс опустел
+  {
+    heap_index->words[cls / 64] &= ~(UINT64_C(1) << (cls % 64));
+    if (!heap_index->words[cls / 64])
+      heap_index->summary &= ~(UINT64_C(1) << (cls / 64));
+  }
+  memset(block->contents + block->capacity.bytes - sizeof(links), 0, sizeof(links));
+  heap_index->blocks--;
+  heap_index->bytes -= block->capacity.bytes;
+}
+
+/**
+ * @brief Поиск наименьшего непустого класса, начиная с заданного
+ * @param[in] heap_index Указатель на сводку пула
+ * @param[in] cls Номер класса
+ * @return Номер найденного класса или INDEX_CLASSES, если такого нет
+*/
+static size_t index_find_from( struct free_index const* heap_index, size_t cls )
+{
+  if (cls >= INDEX_CLASSES)
+    return INDEX_CLASSES;
+  const uint64_t word = heap_index->words[cls / 64] & (~UINT64_C(0) << (cls % 64));
+  if (word) // Подходящий класс в том же слове
+    return cls / 64 * 64 + __builtin_ctzll(word);
+
+  const size_t next_word = cls / 64 + 1;
+  const uint64_t words = next_word < INDEX_WORDS ? heap_index->summary & (~UINT64_C(0) << next_word) : 0;
+  if (!words) // Старших непустых слов нет
+    return INDEX_CLASSES;
+  const size_t w = __builtin_ctzll(words);
+  return w * 64 + __builtin_ctzll(heap_index->words[w]);
+}
+
+/**
+ * @brief Выбор блока с наименьшим адресом среди первых блоков списка класса
+ * @details Блоки у начала пула заполняются первыми, как при поиске первого подходящего блока,
+ *          а конец пула остается свободным для возврата ОС
+ * @param[in] block Первый блок списка
+ * @param[in] query Запрашиваемая память в байтах
+ * @return Указатель на структуру подходящего блока или NULL
+*/
+static struct block_header* list_find_lowest( struct block_header* block, size_t query )
+{
+  struct block_header* best = NULL;
+  for (size_t i = 0; block && i < INDEX_SCAN_LIMIT; ++i, block = links_get(block).next)
+    if (block->capacity.bytes >= query && (!best || block < best))
+      best = block;
+  return best;
+}
+
+/**
+ * @brief Поиск свободного блока, вмещающего запрос, по спискам классов
+ * @details Сначала просматривается список класса самого запроса, чтобы не дробить крупные блоки.
+ *          Любой блок старшего класса точно вмещает запрос, поэтому дальше берется
+ *          наименьший непустой старший класс. Просмотр списка ограничен INDEX_SCAN_LIMIT блоками
+ * @param[in] heap_index Указатель на сводку пула
+ * @param[in] query Запрашиваемая память в байтах
+ * @return Указатель на структуру свободного блока или NULL
+*/
+static struct block_header* index_find_block( struct free_index const* heap_index, size_t query )
+{
+  const size_t cls = size_class(query);
+  struct block_header* const block = list_find_lowest(heap_index->lists[cls], query);
+  if (block)
+    return block;
+  const size_t bigger = index_find_from(heap_index, cls + 1);
+  return bigger < INDEX_CLASSES ? list_find_lowest(heap_index->lists[bigger], query) : NULL;
+}
+
+/**
+ * @brief Проверка того, может ли запрос поместиться в пул хотя бы после слияния всех свободных блоков
+ * @param[in] heap_index Указатель на сводку пула
+ * @param[in] query Запрашиваемая память в байтах
+ * @return false, если суммарной свободной памяти заведомо не хватит, иначе true
+*/
+static bool index_may_fit( struct free_index const* heap_index, size_t query )
+{
+  if (!heap_index->blocks)
+    return false;
+  return heap_index->bytes + (heap_index->blocks - 1) * offsetof(struct block_header, contents) >= query;
+}
+
+/**
+ * @brief Передача состояния блока следующему за ним вплотную блоку
+ * @param[in] block Указатель на структуру блока
+*/
+static void block_sync_next( struct block_header const* block )
+{
+  if (block->next && (void*) block->next == (void*) (block->contents + block->capacity.bytes))
+    block->next->prev_free = block->is_free;
+}
+
+/**
+ * @brief Поиск начала свободного блока, вплотную предшествующего заданному
+ * @param[in] block Указатель на структуру блока, у которого установлен prev_free
+ * @return Указатель на структуру предыдущего блока
+*/
+static struct block_header* block_before( struct block_header const* block )
+{
+  struct free_links links;
+  memcpy(&links, (uint8_t const*) block - sizeof(links), sizeof(links)); // Связи лежат в конце данных предыдущего блока
+  return links.block;
+}
+
+/**
+ * @brief Пометка блока занятым
+ * @param[out] block Указатель на структуру блока
+*/
+static void block_take( struct block_header* block )
+{
+  if (!block->is_free)
+    return;
+  index_remove(block);
+  block->is_free = false;
+  block_sync_next(block);
+}
+
+/**
+ * @brief Округление адреса вверх до границы выравнивания
+ * @param[in] addr Адрес
+ * @param[in] alignment Выравнивание (степень двойки)
+ * @return Выровненный адрес
+*/
+static uintptr_t align_up( uintptr_t addr, size_t alignment ) { return (addr + alignment - 1) & ~(uintptr_t) (alignment - 1); }
+
 /**
  * @brief Расчет действительного размера региона памяти
  * @param[in] query Запрашивая память в байтах
@@ -72,14 +339,73 @@ static void* map_pages(void const* addr, size_t length, int additional_flags)
   return mmap( (void*) addr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | additional_flags , -1, 0 );
 }
 
+/**
+ * @brief Учет отображенной памяти в участках адресов кучи
+ * @param[in] addr Указатель на начало памяти
+ * @param[in] size Размер памяти в байтах
+ * @return true, если память учтена, иначе false (нет места под новый участок)
+*/
+static bool ranges_add( void const* addr, size_t size )
+{
+  const uintptr_t start = (uintptr_t) addr;
+  const uintptr_t end = start + size;
+  for (size_t i = 0; i < heap_ranges_count; ++i)
+    if (heap_ranges[i].end == start || heap_ranges[i].start == end) // Смежный участок расширяется
+    {
+      heap_ranges[i].start = size_min(heap_ranges[i].start, start);
+      heap_ranges[i].end = size_max(heap_ranges[i].end, end);
+      return true;
+    }
+  if (heap_ranges_count == HEAP_RANGES)
+    return false;
+  heap_ranges[heap_ranges_count].start = start;
+  heap_ranges[heap_ranges_count].end = end;
+  heap_ranges_count++;
+  return true;
+}
+
+/**
+ * @brief Исключение возвращенной ОС памяти из участков адресов кучи
+ * @param[in] addr Указатель на начало памяти
+ * @param[in] size Размер памяти в байтах
+*/
+static void ranges_remove( void const* addr, size_t size )
+{
+  const uintptr_t start = (uintptr_t) addr;
+  const uintptr_t end = start + size;
+  for (size_t i = 0; i < heap_ranges_count; ++i)
+  {
+    if (heap_ranges[i].end <= start || heap_ranges[i].start >= end) // Участки не пересекаются
+      continue;
+    if (heap_ranges[i].start >= start && heap_ranges[i].end <= end) // Участок удален целиком
+    {
+      heap_ranges[i--] = heap_ranges[--heap_ranges_count];
+      continue;
+    }
+    if (heap_ranges[i].start < start && heap_ranges[i].end > end) // Дыра в середине участка
+    {
+      if (heap_ranges_count == HEAP_RANGES) // Нет места под вторую часть: дыра остается в участке
+        continue;
+      heap_ranges[heap_ranges_count].start = end;
+      heap_ranges[heap_ranges_count].end = heap_ranges[i].end;
+      heap_ranges_count++;
+    }
+    if (heap_ranges[i].start < start)
+      heap_ranges[i].end = start;
+    else
+      heap_ranges[i].start = end;
+  }
+}
+
 /*  аллоцировать регион памяти и инициализировать его блоком */
 /**
  * @brief Аллокация региона памяти и инициализация блоком
  * @param[in] addr Указатель на адрес начала региона
  * @param[in] query Запрашиваемый размер в байтах
+ * @param[in] pool Пул, которому принадлежит регион
  * @return Структурп региона
 */
-static struct region alloc_region( void const * addr, size_t query ) 
+static struct region alloc_region( void const * addr, size_t query, enum heap_pool pool ) 
 {
   struct region reg;
   query = region_actual_size(query); // Выбор действительного размера региона
@@ -94,12 +420,15 @@ static struct region alloc_region( void const * addr, size_t query )
   else // Если не удалось выделить память
   {
     next_addr = map_pages(addr, query, NO_ADDITIONAL_FLAG); // Пробуем выделить память, где получится
+    if (next_addr == MAP_FAILED) // ОС не дала памяти
+      return REGION_INVALID;
     reg.addr = next_addr;
     reg.size = query;
     reg.extends = false;
   }
 
-  block_init(next_addr, (block_size){.bytes = query}, NULL); // Инициализация блока в регионе
+  block_init(next_addr, (block_size){.bytes = query}, NULL); // Только что отображенные страницы заполнены нулями
+  ((struct block_header*) next_addr)->pool = pool;
   return reg;
 }
 
@@ -112,20 +441,83 @@ static void* block_after( struct block_header const* block );
 
 void* heap_init( size_t initial ) 
 {
-  const struct region region = alloc_region( HEAP_START, initial );
-  if ( region_is_invalid(&region) ) 
+  pthread_mutex_lock(&heap_mutex);
+  if (heap_ready) // Повторная инициализация не должна терять живую кучу
+  {
+    void* const head = heap_pools[HEAP_POOL_DEFAULT].head;
+    pthread_mutex_unlock(&heap_mutex);
+    return head;
+  }
+  const struct region region = alloc_region( HEAP_START, initial, HEAP_POOL_DEFAULT );
+  heap_ready = !region_is_invalid(&region);
+  maintain_cursor = NULL;
+  for (size_t i = 0; i < HEAP_POOLS; ++i)
+    heap_pools[i] = (struct heap_pool_state) {0};
+  heap_pools[HEAP_POOL_DEFAULT].head = heap_ready ? region.addr : NULL;
+  heap_pools[HEAP_POOL_DEFAULT].tail = heap_pools[HEAP_POOL_DEFAULT].head;
+  heap_mapped = heap_ready ? region.size : 0;
+  heap_limit_hit = false;
+  heap_ranges_count = 0;
+  if (heap_ready)
+  {
+    ranges_add(region.addr, region.size);
+    index_add(region.addr);
+  }
+  pthread_mutex_unlock(&heap_mutex);
+
+  if ( !heap_ready ) 
     return NULL;
   return region.addr;
 }
 
+/**
+ * @brief Возврат ОС всех регионов пула
+ * @param[in] pool Указатель на состояние пула
+*/
+static void pool_unmap( struct heap_pool_state* pool )
+{
+  struct block_header* block = pool->head;
+  while (block) // Регион - это цепочка блоков, идущих в памяти друг за другом
+  {
+    void* const start = block;
+    while (block->next && (void*) block->next == (void*) (block->contents + block->capacity.bytes))
+      block = block->next;
+    void* const end = block->contents + block->capacity.bytes;
+    block = block->next;
+    munmap(start, (uint8_t*) end - (uint8_t*) start);
+    ranges_remove(start, (uint8_t*) end - (uint8_t*) start);
+  }
+  *pool = (struct heap_pool_state) {0};
+}
+
 void heap_kill(void* heap, size_t size)
 {
-  if (heap != NULL)
+  if (heap == NULL)
+    return;
+
+  pthread_mutex_lock(&heap_mutex);
+  if (heap_ready && heap == heap_pools[HEAP_POOL_DEFAULT].head) // Вместе с кучей удаляются все регионы пулов и состояние обслуживания
+  {
+    heap_ready = false;
+    maintain_cursor = NULL;
+    for (size_t i = 0; i < HEAP_POOLS; ++i)
+      pool_unmap(&heap_pools[i]);
+    heap_mapped = 0;
+    heap_limit_hit = false;
+    heap_ranges_count = 0;
+  }
+  else
+  {
     munmap(heap, size);
+    ranges_remove(heap, size);
+  }
+  pthread_mutex_unlock(&heap_mutex);
 }
 
 #define BLOCK_MIN_CAPACITY 24 // Минимальный размер блока в байтах
 
+_Static_assert(BLOCK_MIN_CAPACITY >= sizeof(struct free_links), "Связи списка класса не помещаются в минимальный блок");
+
 /*  --- Разделение блоков (если найденный свободный блок слишком большой )--- */
 /**
  * @brief Проверка того, можно ли разделить блока на два меньших
@@ -153,10 +545,20 @@ static bool split_if_too_big( struct block_header* block, size_t query )
   block_size size = { // Уменьшение размера текущего блока
     .bytes = block->capacity.bytes - query
   };
+  index_remove(block);
   struct block_header* new_block = (struct block_header*)(block->contents + query); // Иницализация нового пустого блока
   block_init(new_block, size, block->next);
+  new_block->dirty_bytes = dirty_after(block, query + offsetof(struct block_header, contents));
+  new_block->pool = block->pool;
+  new_block->prev_free = block->is_free;
+  block_sync_next(new_block);
   block->capacity.bytes = query; 
+  block->dirty_bytes = size_min(block->dirty_bytes, query);
   block->next = new_block;
+  index_add(block);
+  index_add(new_block);
+  if (block_pool(block)->tail == block)
+    block_pool(block)->tail = new_block;
 
   return true;
 }
@@ -201,8 +603,21 @@ static bool try_merge_with_next( struct block_header* block )
     struct block_header* restrict next_block = block->next; 
     if (next_block && mergeable(block, next_block)) // Если блоки можно слить
     {
+      index_remove(block);
+      index_remove(next_block);
+      if (block_pool(block)->tail == next_block)
+        block_pool(block)->tail = block;
+      if (block_pool(block)->compact_cursor == next_block) // Уплотнение продолжится с поглотившего блока
+        block_pool(block)->compact_cursor = block;
+      const size_t joint = block->capacity.bytes + offsetof(struct block_header, contents); // Смещение данных второго блока
       block->next = next_block->next;
       block->capacity.bytes += offsetof(struct block_header, contents) + next_block->capacity.bytes;
+      if (next_block->dirty_bytes) // Грязная часть продолжается до конца грязной части второго блока
+        block->dirty_bytes = joint + next_block->dirty_bytes;
+      else // Заголовок чистого второго блока становится частью данных и должен быть обнулен
+        memset(next_block, 0, offsetof(struct block_header, contents));
+      block_sync_next(block);
+      index_add(block);
       return true;
     }
   }
@@ -224,9 +639,10 @@ struct block_search_result
  * @brief Поиск хорошего блока
  * @param[in] block Указатель на структуру текущего блока
  * @param[in] sz Запрашиваемый размер блока в байтах
+ * @param[in] merge Флаг слияния свободных блоков во время поиска
  * @return Структура с результатами поиска
 */
-static struct block_search_result find_good_or_last  ( struct block_header* restrict block, size_t sz )   
+static struct block_search_result find_good_or_last  ( struct block_header* restrict block, size_t sz, bool merge )   
 {
   struct block_header* cur_block = block;
   struct block_search_result res;
@@ -245,7 +661,7 @@ static struct block_search_result find_good_or_last  ( struct block_header* rest
       res.block = cur_block;
       return res;
     }
-    if (!try_merge_with_next(cur_block)) // Если не получается слить текущий блок со следующим
+    if (!merge || !try_merge_with_next(cur_block)) // Если не получается слить текущий блок со следующим
       cur_block = cur_block->next;
   }
   if (cur_block->is_free && block_is_big_enough(sz, cur_block)) // Проверка последнего блока
@@ -263,6 +679,10 @@ static struct block_search_result find_good_or_last  ( struct block_header* rest
  Можно переиспользовать как только кучу расширили. */
  /**
   * @brief Попытка выделить память в куче с заданного блока
+  * @details Блок ищется по спискам классов, и только если там подходящего нет,
+  *          цепочка блоков просматривается со слиянием соседних свободных блоков.
+  *          В отложенном режиме слиянием занимается обслуживание: вместо него будится обработчик
+  *          нехватки памяти, а куча расширяется
   * @param[in] query Запрашиваемый размер в байтах
   * @param[in] block Указатель на структуру текущего блока
   * @return Структура с результатами поиска
@@ -270,15 +690,63 @@ static struct block_search_result find_good_or_last  ( struct block_header* rest
 static struct block_search_result try_memalloc_existing ( size_t query, struct block_header* block )
 {
   query = size_max(query, BLOCK_MIN_CAPACITY); // Выбор действительного размера запрашиваемой памяти
-  struct block_search_result res = find_good_or_last(block, query);
+  struct block_search_result res = { .type = BSR_FOUND_GOOD_BLOCK, .block = NULL };
+  if (block)
+    res.block = index_find_block(&block_pool(block)->index, query);
+  if (!res.block && block && heap_deferred) // Обработчик вызывается уже после снятия блокировки кучи
+  {
+    pressure_hook_pending = heap_pressure_hook;
+    return (struct block_search_result) { .type = BSR_REACHED_END_NOT_FOUND, .block = block_pool(block)->tail };
+  }
+  if (!res.block) // Подходящий блок может появиться только после слияния
+  {
+    maintain_cursor = NULL; // Слияние при поиске может поглотить блок, на котором остановилось обслуживание
+    res = find_good_or_last(block, query, true);
+  }
   if (res.type == BSR_FOUND_GOOD_BLOCK) // Если блок найден
   {
     split_if_too_big(res.block, query); // Пробуем уменьшить
-    res.block->is_free = false;
+    block_take(res.block);
   }
   return res;
 }
 
+/**
+ * @brief Отображение нового региона пула с учетом лимитов
+ * @param[in] addr Желаемый адрес начала региона
+ * @param[in] query Запрашиваемый размер в байтах
+ * @param[in] pool Пул, которому принадлежит регион
+ * @return Первый (свободный) блок региона или NULL
+*/
+static struct block_header* map_region( void const* addr, size_t query, enum heap_pool pool )
+{
+  const size_t actual = region_actual_size(query);
+  if (heap_hard_limit && (actual > heap_hard_limit || heap_mapped > heap_hard_limit - actual)) // Расширение превысит жесткий лимит
+  {
+    heap_error = HEAP_ERR_LIMIT;
+    if (!heap_limit_hit) // Обработчики вызываются один раз при достижении лимита
+      __atomic_store_n(&heap_pressure, true, __ATOMIC_RELEASE);
+    heap_limit_hit = true;
+    return NULL;
+  }
+  const struct region reg = alloc_region(addr, query, pool);
+
+  if (region_is_invalid(&reg) || !ranges_add(reg.addr, reg.size)) // если выделить или учесть память не получилось
+  {
+    if (!region_is_invalid(&reg))
+      munmap(reg.addr, reg.size);
+    heap_error = HEAP_ERR_MAP;
+    return NULL;
+  }
+  if (heap_soft_limit && heap_mapped <= heap_soft_limit && reg.size > heap_soft_limit - heap_mapped) // Пересечение мягкого лимита
+    __atomic_store_n(&heap_pressure, true, __ATOMIC_RELEASE);
+  heap_mapped += reg.size;
+  heap_limit_hit = false;
+
+  index_add(reg.addr);
+  return reg.addr;
+}
+
 /**
  * @brief Увеличение размера кучи
  * @param[out] last Указатель на последний блок в куче
@@ -288,55 +756,348 @@ static struct block_search_result try_memalloc_existing ( size_t query, struct b
 static struct block_header* grow_heap( struct block_header* restrict last, size_t query ) 
 {
   query += offsetof(struct block_header, contents);
-  const struct region reg = alloc_region(block_after(last), query);
-
-  if (region_is_invalid(&reg)) // если выделить память не получилось
+  struct block_header* const head = map_region(block_after(last), query, last->pool);
+  if (!head)
     return NULL;
 
-  last->next = (struct block_header*) reg.addr;
+  last->next = head;
+  if (block_pool(last)->tail == last)
+    block_pool(last)->tail = head;
   if (try_merge_with_next(last)) // Попытка объелинить новый блок с последним из кучи
     return last;
   return last->next;
 }
 
+/**
+ * @brief Создание пула при первом выделении из него
+ * @param[in] pool Пул
+ * @param[in] query Запрашиваемая память в байтах
+ * @return true, если пул создан, иначе false
+*/
+static bool pool_create( enum heap_pool pool, size_t query )
+{
+  void const* addr = (uint8_t*) HEAP_START + pool * POOL_SPACING; // Пулы растут вдали друг от друга
+  struct block_header* const head = map_region(addr, query + offsetof(struct block_header, contents), pool);
+  if (!head)
+    return false;
+  heap_pools[pool].head = head;
+  heap_pools[pool].tail = head;
+  return true;
+}
+
 /*  Реализует основную логику malloc и возвращает заголовок выделенного блока */
 /**
  * @brief Выделение памяти 
  * @param[in] query Запрашиваемая память в байтах
- * @param[in] heap_start Указатель на начало кучи
+ * @param[in] pool Пул, из которого выделяется память
  * @return Указатель на заголовок выделенного блока
 */
-static struct block_header* memalloc( size_t query, struct block_header* heap_start)
+static struct block_header* memalloc( size_t query, enum heap_pool pool )
 {
   query = size_max(query, BLOCK_MIN_CAPACITY); // Выбор действительного размера запрашиваемой памяти
-  struct block_search_result res = try_memalloc_existing(query, heap_start); // Выбор блока без расширения кучи
+  heap_error = HEAP_OK;
+  if (query > SIZE_MAX - offsetof(struct block_header, contents) - REGION_MIN_SIZE) // Заголовок и регион не поместятся в size_t
+  {
+    heap_error = HEAP_ERR_INVALID;
+    return NULL;
+  }
+  if (pool == HEAP_POOL_MOVABLE) // Блоки пула идут с шагом BLOCK_ALIGNMENT, поэтому данные не теряют выравнивание при сдвигах
+    query = align_up(query + offsetof(struct block_header, contents), BLOCK_ALIGNMENT) - offsetof(struct block_header, contents);
+  struct heap_pool_state* const state = &heap_pools[pool];
+  if (!heap_ready || (!state->head && (pool == HEAP_POOL_DEFAULT || !pool_create(pool, query)))) // Пулы живут только при инициализированной куче
+  {
+    if (heap_error == HEAP_OK)
+      heap_error = HEAP_ERR_INVALID;
+    return NULL;
+  }
 
+  struct block_search_result res;
+  if (!index_may_fit(&state->index, query)) // Свободной памяти заведомо не хватит: сразу расширяем пул
+    res = (struct block_search_result) {.type = BSR_REACHED_END_NOT_FOUND, .block = state->tail};
+  else
+    res = try_memalloc_existing(query, state->head); // Выбор блока без расширения кучи
+
+  if (res.type == BSR_FOUND_GOOD_BLOCK)
+    return res.block;
   if (res.type != BSR_CORRUPTED) // Если адрес кучи был валидным
   {
-    if (res.type != BSR_FOUND_GOOD_BLOCK) // Если не удалось найти хороший блок
+    struct block_header* const grown = grow_heap(res.block, query); // Увеличение кучи
+    if (!grown && heap_deferred && index_may_fit(&state->index, query)) // Расширяться некуда: сливаем блоки, не дожидаясь обслуживания
     {
-      struct block_header* head = grow_heap(res.block, query); // Увеличение кучи
-      if (!head)
-        return NULL;
-      res = try_memalloc_existing(query, res.block); // Повторный поиск
-      if (res.type == BSR_CORRUPTED) // Если адрес последнего блока кучи не валидный
+      maintain_cursor = NULL;
+      res = find_good_or_last(state->head, query, true);
+      if (res.type != BSR_FOUND_GOOD_BLOCK)
         return NULL;
+      heap_error = HEAP_OK;
+      split_if_too_big(res.block, query);
+      block_take(res.block);
+      return res.block;
+    }
+    if (!grown)
+      return NULL;
+    if (grown->is_free && block_is_big_enough(query, grown)) // Расширенная куча обязана вместить запрос
+    {
+      split_if_too_big(grown, query);
+      block_take(grown);
+      return grown;
     }
-    res.block->is_free = false;
-    return res.block;
   }
+  heap_error = HEAP_ERR_INVALID;
   return NULL;
 }
 
+void* heap_pool_start( enum heap_pool pool )
+{
+  if (pool >= HEAP_POOLS)
+    return NULL;
+  pthread_mutex_lock(&heap_mutex);
+  void* const head = heap_pools[pool].head;
+  pthread_mutex_unlock(&heap_mutex);
+  return head;
+}
+
+bool heap_index_valid( enum heap_pool pool )
+{
+  if (pool >= HEAP_POOLS)
+    return false;
+  pthread_mutex_lock(&heap_mutex);
+  struct heap_pool_state const* const state = &heap_pools[pool];
+  struct free_index expected = {0}; // Сводка, пересчитанная по цепочке блоков
+  struct block_header const* last = NULL;
+  bool prev_ok = true; // Флаги prev_free должны совпадать с занятостью соседей в памяти
+  for (struct block_header const* block = state->head; block; block = block->next)
+  {
+    prev_ok = prev_ok && block->prev_free == (last && last->is_free && block_after(last) == (void*) block);
+    last = block;
+    if (!block->is_free)
+      continue;
+    const size_t cls = size_class(block->capacity.bytes);
+    expected.words[cls / 64] |= UINT64_C(1) << (cls % 64);
+    expected.summary |= UINT64_C(1) << (cls / 64);
+    expected.blocks++;
+    expected.bytes += block->capacity.bytes;
+  }
+  bool valid = prev_ok && last == state->tail && expected.summary == state->index.summary && expected.blocks == state->index.blocks
+    && expected.bytes == state->index.bytes && memcmp(expected.words, state->index.words, sizeof(expected.words)) == 0;
+
+  size_t listed = 0; // Списки классов должны содержать ровно свободные блоки пула
+  for (size_t cls = 0; cls < INDEX_CLASSES && valid; ++cls)
+  {
+    struct block_header const* prev = NULL;
+    for (struct block_header const* block = state->index.lists[cls]; block && valid; block = links_get(block).next)
+    {
+      valid = ++listed <= expected.blocks && block->is_free && block->pool == pool
+        && size_class(block->capacity.bytes) == cls && links_get(block).prev == prev;
+      prev = block;
+    }
+  }
+  valid = valid && listed == expected.blocks;
+  pthread_mutex_unlock(&heap_mutex);
+  return valid;
+}
+
+/**
+ * @brief Выделение памяти с выравниванием начала данных
+ * @param[in] query Запрашиваемая память в байтах
+ * @param[in] alignment Выравнивание (степень двойки)
+ * @param[in] pool Пул, из которого выделяется память
+ * @return Указатель на заголовок выделенного блока
+*/
+static struct block_header* memalloc_aligned( size_t query, size_t alignment, enum heap_pool pool )
+{
+  const size_t header = offsetof(struct block_header, contents);
+  if (query > SIZE_MAX / 2 || alignment > SIZE_MAX / 4) // Защита от переполнения при расчете запаса
+  {
+    heap_error = HEAP_ERR_INVALID;
+    return NULL;
+  }
+  // Размер подбирается так, чтобы данные следующего блока тоже оказались выровнены
+  query = align_up(size_max(query, BLOCK_MIN_CAPACITY) + header, BLOCK_ALIGNMENT) - header;
+
+  struct block_header* block = memalloc(query + alignment + header + BLOCK_MIN_CAPACITY, pool);
+  if (!block)
+    return NULL;
+
+  if ((uintptr_t) block->contents % alignment) // Отделяем свободный блок перед выровненными данными
+  {
+    const uintptr_t aligned = align_up((uintptr_t) block->contents + header + BLOCK_MIN_CAPACITY, alignment);
+    struct block_header* moved = (struct block_header*) (aligned - header);
+    const size_t front = (uint8_t*) moved - block->contents;
+    *moved = (struct block_header) {
+      .next = block->next,
+      .capacity = {block->capacity.bytes - front - header},
+      .dirty_bytes = dirty_after(block, front + header),
+      .is_free = false,
+      .pool = block->pool,
+      .prev_free = true
+    };
+    block->next = moved;
+    block->capacity.bytes = front;
+    block->dirty_bytes = size_min(block->dirty_bytes, front);
+    block->is_free = true;
+    index_add(block);
+    if (block_pool(block)->tail == block)
+      block_pool(block)->tail = moved;
+    block = moved;
+  }
+
+  block->is_free = true; // Возвращаем в кучу запас после данных
+  index_add(block);
+  if (split_if_too_big(block, query) && !heap_deferred)
+  {
+    maintain_cursor = NULL;
+    try_merge_with_next(block->next);
+  }
+  block_take(block);
+  return block;
+}
+
+/**
+ * @brief Обработка превышения лимитов: вызов обработчиков и возврат свободных страниц ОС
+ * @details Вызывается без захваченной кучи, чтобы обработчики могли освобождать память
+ * @return true, если обработчики были вызваны, иначе false
+*/
+static bool pressure_dispatch( void )
+{
+  // Флаг почти всегда сброшен: обычное чтение не захватывает строку кэша на запись при каждом выделении
+  if (!__atomic_load_n(&heap_pressure, __ATOMIC_RELAXED) || !__atomic_exchange_n(&heap_pressure, false, __ATOMIC_ACQ_REL))
+    return false;
+
+  struct { heap_pressure_callback cb; void* arg; } callbacks[HEAP_PRESSURE_CALLBACKS];
+  pthread_mutex_lock(&heap_mutex); // Обработчики копируются, чтобы их можно было менять во время вызова
+  const size_t count = pressure_callbacks_count;
+  memcpy(callbacks, pressure_callbacks, count * sizeof(callbacks[0]));
+  const size_t mapped = heap_mapped;
+  pthread_mutex_unlock(&heap_mutex);
+  for (size_t i = 0; i < count; ++i)
+    callbacks[i].cb(mapped, callbacks[i].arg);
+
+  heap_maintain(SIZE_MAX, REGION_MIN_SIZE); // Завершение текущего прохода обслуживания
+  heap_maintain(SIZE_MAX, REGION_MIN_SIZE); // Полный проход с возвратом страниц
+  return true;
+}
+
+/**
+ * @brief Выделение памяти под блокировкой кучи
+ * @param[in] query Запрашиваемая память в байтах
+ * @param[in] alignment Выравнивание (степень двойки) или 0, если выравнивание не требуется
+ * @param[in] pool Пул, из которого выделяется память
+ * @param[out] dirty Кол-во байт данных, которые нужно обнулить, или NULL, если обнуление не требуется
+ * @return Указатель на заголовок выделенного блока или NULL
+*/
+static struct block_header* memalloc_locked( size_t query, size_t alignment, enum heap_pool pool, size_t* dirty )
+{
+  pthread_mutex_lock(&heap_mutex);
+  struct block_header* const addr = alignment
+    ? memalloc_aligned( query, alignment, pool )
+    : memalloc( query, pool );
+  if (addr && dirty) // Заголовок читается только под блокировкой
+    *dirty = size_min(addr->dirty_bytes, query);
+  pthread_mutex_unlock(&heap_mutex);
+
+  void (*const hook)( void ) = pressure_hook_pending; // Обработчик может захватывать свои блокировки и обращаться к куче
+  pressure_hook_pending = NULL;
+  if (hook)
+    hook();
+  return addr;
+}
+
+/**
+ * @brief Выделение памяти с обработкой лимитов
+ * @details Если выделение не удалось, а обработчики были вызваны, оно повторяется один раз:
+ *          обработчики могли освободить память
+ * @param[in] query Запрашиваемая память в байтах
+ * @param[in] alignment Выравнивание (степень двойки) или 0, если выравнивание не требуется
+ * @param[in] pool Пул, из которого выделяется память
+ * @param[out] dirty Кол-во байт данных, которые нужно обнулить, или NULL, если обнуление не требуется
+ * @return Указатель на заголовок выделенного блока или NULL
+*/
+static struct block_header* heap_alloc( size_t query, size_t alignment, enum heap_pool pool, size_t* dirty )
+{
+  struct block_header* addr = memalloc_locked(query, alignment, pool, dirty);
+  if (pressure_dispatch() && !addr)
+    addr = memalloc_locked(query, alignment, pool, dirty);
+  return addr;
+}
+
 void* _malloc( size_t query ) 
 {
-  struct block_header* const addr = memalloc( query, (struct block_header*) HEAP_START );
+  struct block_header* const addr = heap_alloc( query, 0, HEAP_POOL_DEFAULT, NULL );
   if (addr) 
     return addr->contents;
   else 
     return NULL;
 }
 
+void* _malloc_ex( size_t query, unsigned flags )
+{
+  enum heap_pool pool = HEAP_POOL_DEFAULT;
+  if (flags & MEM_HINT_MOVABLE)
+    pool = HEAP_POOL_MOVABLE;
+  else if ((flags & MEM_HINT_SHORT_LIVED) && !(flags & MEM_HINT_LONG_LIVED))
+    pool = HEAP_POOL_SHORT;
+  else if ((flags & MEM_HINT_LONG_LIVED) && !(flags & MEM_HINT_SHORT_LIVED))
+    pool = HEAP_POOL_LONG;
+
+  struct block_header* const addr = heap_alloc( query, 0, pool, NULL );
+  if (addr)
+    return addr->contents;
+  else
+    return NULL;
+}
+
+/**
+ * @brief Выделение обнуленной памяти
+ * @param[in] nmemb Кол-во элементов массива
+ * @param[in] size Размер элемента в байтах
+ * @param[in] alignment Выравнивание (степень двойки) или 0, если выравнивание не требуется
+ * @return Указатель на адрес начала данных в памяти или NULL
+*/
+static void* calloc_impl( size_t nmemb, size_t size, size_t alignment )
+{
+  if (size && nmemb > SIZE_MAX / size) // Переполнение при расчете размера
+  {
+    heap_error = HEAP_ERR_INVALID;
+    return NULL;
+  }
+  const size_t query = nmemb * size;
+
+  size_t dirty = 0;
+  struct block_header* const addr = heap_alloc( query, alignment, HEAP_POOL_DEFAULT, &dirty );
+  if (!addr)
+    return NULL;
+
+  memset(addr->contents, 0, dirty); // Обнуляем только память, которая уже использовалась
+  return addr->contents;
+}
+
+void* _calloc( size_t nmemb, size_t size ) { return calloc_impl(nmemb, size, 0); }
+
+void* _malloc_aligned( size_t alignment, size_t query )
+{
+  if (!alignment || (alignment & (alignment - 1))) // Выравнивание должно быть степенью двойки
+  {
+    heap_error = HEAP_ERR_INVALID;
+    return NULL;
+  }
+
+  struct block_header* const addr = heap_alloc( query, alignment, HEAP_POOL_DEFAULT, NULL );
+  if (addr)
+    return addr->contents;
+  else
+    return NULL;
+}
+
+void* _calloc_aligned( size_t alignment, size_t nmemb, size_t size )
+{
+  if (!alignment || (alignment & (alignment - 1))) // Выравнивание должно быть степенью двойки
+  {
+    heap_error = HEAP_ERR_INVALID;
+    return NULL;
+  }
+  return calloc_impl(nmemb, size, alignment);
+}
+
 /**
  * @brief Получение заголовка блока
  * @param[in] contents Указатель на адрес данных блока
@@ -351,6 +1112,256 @@ void _free( void* mem )
   if (!mem) 
     return ;
   struct block_header* header = block_get_header( mem );
+  pthread_mutex_lock(&heap_mutex);
   header->is_free = true;
-  while (header->next && try_merge_with_next(header));
+  header->dirty_bytes = header->capacity.bytes;
+  block_sync_next(header);
+  index_add(header);
+  if (!heap_deferred) // В отложенном режиме слиянием занимается обслуживание кучи
+  {
+    maintain_cursor = NULL;
+    while (header->next && try_merge_with_next(header));
+    if (header->prev_free) // Предыдущий свободный блок поглощает освобожденный
+      try_merge_with_next(block_before(header));
+  }
+  pthread_mutex_unlock(&heap_mutex);
+}
+
+bool heap_owns( void const* ptr )
+{
+  const uintptr_t addr = (uintptr_t) ptr;
+  bool owned = false;
+  pthread_mutex_lock(&heap_mutex);
+  for (size_t i = 0; i < heap_ranges_count && !owned; ++i)
+    owned = addr >= heap_ranges[i].start && addr < heap_ranges[i].end;
+  pthread_mutex_unlock(&heap_mutex);
+  return owned;
+}
+
+size_t _malloc_usable_size( void* mem )
+{
+  if (!mem)
+    return 0;
+  return block_get_header( mem )->capacity.bytes;
+}
+
+/*  --- Обслуживание кучи --- */
+void heap_set_deferred( bool deferred, void (*on_pressure)( void ) )
+{
+  pthread_mutex_lock(&heap_mutex);
+  heap_deferred = deferred;
+  heap_pressure_hook = deferred ? on_pressure : NULL;
+  pthread_mutex_unlock(&heap_mutex);
+}
+
+/**
+ * @brief Возврат операционной системе целых страниц внутри грязной части свободного блока
+ * @param[in] block Указатель на структуру свободного блока
+*/
+static void block_trim( struct block_header* block )
+{
+  const size_t page = getpagesize();
+  const uintptr_t links = (uintptr_t) block_after(block) - sizeof(struct free_links); // Связи списка класса сохраняются
+  const uintptr_t dirty_end = size_min((uintptr_t) block->contents + block->dirty_bytes, links);
+  const uintptr_t begin = align_up((uintptr_t) block->contents, page);
+  const uintptr_t end = dirty_end / page * page;
+  if (begin >= end) // Если в грязной части нет ни одной целой страницы
+    return;
+
+  madvise((void*) begin, end - begin, MADV_DONTNEED);
+  memset(block->contents, 0, begin - (uintptr_t) block->contents); // Неполные страницы по краям обнуляются вручную
+  memset((void*) end, 0, dirty_end - end);
+  block->dirty_bytes = 0;
+}
+
+/*  --- Лимиты памяти --- */
+void heap_set_limits( size_t soft, size_t hard )
+{
+  pthread_mutex_lock(&heap_mutex);
+  heap_soft_limit = soft;
+  heap_hard_limit = hard;
+  heap_limit_hit = false;
+  pthread_mutex_unlock(&heap_mutex);
+}
+
+bool heap_add_pressure_callback( heap_pressure_callback cb, void* arg )
+{
+  if (!cb)
+    return false;
+  pthread_mutex_lock(&heap_mutex);
+  const bool added = pressure_callbacks_count < HEAP_PRESSURE_CALLBACKS;
+  if (added)
+  {
+    pressure_callbacks[pressure_callbacks_count].cb = cb;
+    pressure_callbacks[pressure_callbacks_count].arg = arg;
+    pressure_callbacks_count++;
+  }
+  pthread_mutex_unlock(&heap_mutex);
+  return added;
+}
+
+void heap_clear_pressure_callbacks( void )
+{
+  pthread_mutex_lock(&heap_mutex);
+  pressure_callbacks_count = 0;
+  pthread_mutex_unlock(&heap_mutex);
+}
+
+size_t heap_mapped_bytes( void )
+{
+  pthread_mutex_lock(&heap_mutex);
+  const size_t mapped = heap_mapped;
+  pthread_mutex_unlock(&heap_mutex);
+  return mapped;
+}
+
+enum heap_error heap_last_error( void ) { return heap_error; }
+
+void heap_lock( void ) { pthread_mutex_lock(&heap_mutex); }
+
+void heap_unlock( void ) { pthread_mutex_unlock(&heap_mutex); }
+
+bool heap_maintain( size_t max_blocks, size_t trim_threshold )
+{
+  pthread_mutex_lock(&heap_mutex);
+  if (!heap_ready) // Если кучи нет, то и обслуживать нечего
+  {
+    pthread_mutex_unlock(&heap_mutex);
+    return true;
+  }
+
+  struct block_header* block = maintain_cursor ? maintain_cursor : heap_pools[maintain_pool].head;
+  for (size_t i = 0; i < max_blocks; ) // Обработка не более max_blocks блоков за шаг
+  {
+    if (!block) // Конец пула, переход к следующему
+    {
+      if (++maintain_pool == HEAP_POOLS)
+        break;
+      block = heap_pools[maintain_pool].head;
+      continue;
+    }
+    while (try_merge_with_next(block));
+    if (block->is_free && trim_threshold && block->capacity.bytes >= trim_threshold)
+      block_trim(block);
+    block = block->next;
+    ++i;
+  }
+
+  const bool done = maintain_pool == HEAP_POOLS;
+  if (done) // Проход по всем пулам завершен
+    maintain_pool = HEAP_POOL_DEFAULT;
+  maintain_cursor = block;
+  pthread_mutex_unlock(&heap_mutex);
+
+  return done;
+}
+
+/*  --- Уплотнение пула --- */
+#define COMPACT_CLOCK_PERIOD 16 // Кол-во блоков между проверками времени при уплотнении
+
+/**
+ * @brief Текущее время в наносекундах
+ * @return Время в наносекундах
+*/
+static uint64_t now_ns( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief Перенос занятого блока, идущего за свободным, на место свободного
+ * @param[out] hole Указатель на структуру свободного блока
+ * @return Указатель на заголовок перенесенного блока, за ним идет свободный блок прежней вместимости
+*/
+static struct block_header* block_slide( struct block_header* hole )
+{
+  struct block_header* const moving = hole->next;
+  const size_t free_capacity = hole->capacity.bytes;
+  const bool prev_free = hole->prev_free;
+  index_remove(hole);
+
+  memmove(hole, moving, size_from_capacity(moving->capacity).bytes); // Заголовок переносится вместе с данными
+  struct block_header* const moved = hole;
+  struct block_header* const new_hole = block_after(moved);
+  block_init(new_hole, size_from_capacity((block_capacity) {free_capacity}), moved->next);
+  new_hole->dirty_bytes = free_capacity; // На месте дыры остались данные перенесенного блока
+  new_hole->pool = moved->pool;
+  moved->prev_free = prev_free;
+  moved->next = new_hole;
+  block_sync_next(new_hole);
+  index_add(new_hole);
+  if (block_pool(moved)->tail == moving)
+    block_pool(moved)->tail = new_hole;
+  return moved;
+}
+
+/**
+ * @brief Возврат ОС целых страниц в конце свободного блока, которым заканчивается регион
+ * @param[out] block Указатель на структуру свободного блока
+*/
+static void block_release_tail( struct block_header* block )
+{
+  const size_t page = getpagesize();
+  const uintptr_t keep = align_up((uintptr_t) block->contents + BLOCK_MIN_CAPACITY, page);
+  const uintptr_t end = (uintptr_t) block_after(block);
+  if (keep >= end) // Нечего возвращать
+    return;
+
+  index_remove(block);
+  munmap((void*) keep, end - keep);
+  ranges_remove((void*) keep, end - keep);
+  block->capacity.bytes -= end - keep;
+  block->dirty_bytes = size_min(block->dirty_bytes, block->capacity.bytes);
+  heap_mapped -= end - keep;
+  heap_limit_hit = false;
+  index_add(block);
+}
+
+bool heap_compact_step( enum heap_pool pool, uint64_t budget_ns, const struct compact_ops* ops )
+{
+  const uint64_t start = now_ns();
+  const uint64_t deadline = budget_ns > UINT64_MAX - start ? UINT64_MAX : start + budget_ns;
+  if (pool >= HEAP_POOLS)
+    return true;
+  pthread_mutex_lock(&heap_mutex);
+  maintain_cursor = NULL; // Перемещение блоков делает положение обслуживания недействительным
+
+  struct heap_pool_state* const state = &heap_pools[pool];
+  struct block_header* block = state->compact_cursor ? state->compact_cursor : state->head; // Продолжение прохода
+  for (size_t i = 1; block; ++i)
+  {
+    if (i % COMPACT_CLOCK_PERIOD == 0 && now_ns() >= deadline)
+      break;
+
+    while (try_merge_with_next(block));
+    struct block_header* const next = block->next;
+    if (!block->is_free || !next) // Занятый блок остается на месте
+    {
+      if (block->is_free) // Свободный хвост пула
+        block_release_tail(block);
+      block = next;
+      continue;
+    }
+    if (!blocks_continuous(block, next)) // Свободный блок в конце региона
+    {
+      block_release_tail(block);
+      block = next;
+      continue;
+    }
+    if (ops->pinned(next->contents)) // Закрепленный блок перемещать нельзя
+    {
+      block = next;
+      continue;
+    }
+
+    struct block_header* const moved = block_slide(block);
+    ops->moved(moved->contents);
+    block = moved->next;
+  }
+  state->compact_cursor = block; // Следующий шаг продолжит с этого блока, после конца пула - с начала
+  pthread_mutex_unlock(&heap_mutex);
+
+  return block == NULL;
 }
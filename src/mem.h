@@ -9,6 +9,10 @@
 
 #define HEAP_START ((void*)0x04040000) // Адрес начала кучи
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 /**
  * @defgroup MEM Основные операции с выделением памяти
@@ -21,14 +25,102 @@
 */
 void* _malloc( size_t query );
 
+/**
+ * @brief Выделение обнуленной памяти под массив из кучи
+ * @param[in] nmemb Кол-во элементов массива
+ * @param[in] size Размер элемента в байтах
+ * @return Указатель на адрес начала данных в памяти или NULL
+*/
+void* _calloc( size_t nmemb, size_t size );
+
+/**
+ * @brief Пулы кучи: каждый пул растет отдельной цепочкой регионов
+*/
+enum heap_pool
+{
+  HEAP_POOL_DEFAULT = 0, /** Основной пул, начинается с HEAP_START */
+  HEAP_POOL_SHORT,       /** Пул для короткоживущих блоков */
+  HEAP_POOL_LONG,        /** Пул для долгоживущих блоков */
+  HEAP_POOL_MOVABLE,     /** Пул для перемещаемых блоков (см. mem_handle.h) */
+  HEAP_POOLS             /** Кол-во пулов */
+};
+
+/**
+ * @brief Подсказки о времени жизни блока для _malloc_ex
+*/
+enum mem_hint
+{
+  MEM_HINT_NONE = 0,             /** Время жизни неизвестно */
+  MEM_HINT_SHORT_LIVED = 1 << 0, /** Блок скоро будет освобожден (буферы запросов) */
+  MEM_HINT_LONG_LIVED = 1 << 1,  /** Блок живет долго (узлы индексов, кэши) */
+  MEM_HINT_MOVABLE = 1 << 2      /** Блок может перемещаться при уплотнении (используется модулем mem_handle) */
+};
+
+/**
+ * @brief Выделение памяти с подсказкой о времени жизни блока
+ * @details Короткоживущие и долгоживущие блоки размещаются в разных пулах, чтобы дыры от
+ *          освобожденных буферов не оказывались между долгоживущими блоками.
+ *          Пулы создаются лениво, но только после heap_init: до нее вызов завершается с HEAP_ERR_INVALID
+ * @param[in] query Запрашиваемый размер в байтах
+ * @param[in] flags Комбинация флагов mem_hint
+ * @return Указатель на адрес начала данных в памяти или NULL
+*/
+void* _malloc_ex( size_t query, unsigned flags );
+
+/**
+ * @brief Первый блок пула, например для debug_heap
+ * @param[in] pool Пул
+ * @return Указатель на первый блок или NULL, если пул еще не создан
+*/
+void* heap_pool_start( enum heap_pool pool );
+
+/**
+ * @brief Проверка согласованности сводки свободных блоков пула с цепочкой блоков
+ * @param[in] pool Пул
+ * @return true, если счетчики, битовые карты, списки классов, флаги prev_free и последний блок пула совпадают с цепочкой, иначе false
+*/
+bool heap_index_valid( enum heap_pool pool );
+
+/**
+ * @brief Выделение памяти из кучи с выравниванием начала данных
+ * @param[in] alignment Выравнивание в байтах (степень двойки)
+ * @param[in] query Запрашиваемый размер в байтах
+ * @return Указатель на адрес начала данных в памяти или NULL
+*/
+void* _malloc_aligned( size_t alignment, size_t query );
+
+/**
+ * @brief Выделение обнуленной памяти под массив с выравниванием начала данных
+ * @param[in] alignment Выравнивание в байтах (степень двойки)
+ * @param[in] nmemb Кол-во элементов массива
+ * @param[in] size Размер элемента в байтах
+ * @return Указатель на адрес начала данных в памяти или NULL
+*/
+void* _calloc_aligned( size_t alignment, size_t nmemb, size_t size );
+
+/**
+ * @brief Вместимость выделенного блока
+ * @param[in] mem Указатель на адрес начала данных в памяти
+ * @return Кол-во байт, доступных по указателю
+*/
+size_t _malloc_usable_size( void* mem );
+
 /**
  * @brief Освобождение выделенной памяти
  * @param[in] mem Указател на адрес начала данных в памяти
 */
 void  _free( void* mem );
 
+/**
+ * @brief Проверка принадлежности указателя куче
+ * @param[in] ptr Указатель на данные
+ * @return true, если указатель лежит в памяти, отображенной под кучу, иначе false
+*/
+bool heap_owns( void const* ptr );
+
 /**
  * @brief Инициализация кучи
+ * @details Если куча уже инициализирована, возвращается ее начало без изменения состояния
  * @param[in] initial_size Начальный размер кучи
  * @return Указатель на адрес начала кучи или NULL
 */
@@ -36,10 +128,130 @@ void* heap_init( size_t initial_size );
 
 /**
  * @brief Удаление кучи
+ * @details Для кучи, созданной heap_init, ОС возвращаются все регионы всех пулов, а size не используется
  * @param[in] heap Указатель на кучу
  * @param[in] size Размер кучи
 */
 void heap_kill(void* heap, size_t size);
 /**@}*/
 
+/**
+ * @defgroup MEM_LIMITS Лимиты отображенной памяти
+*/
+/**@{*/
+/**
+ * @brief Причина неудачного выделения памяти
+*/
+enum heap_error
+{
+  HEAP_OK = 0,      /** Ошибки нет */
+  HEAP_ERR_LIMIT,   /** Расширение кучи превысило бы жесткий лимит */
+  HEAP_ERR_MAP,     /** ОС не выделила память */
+  HEAP_ERR_INVALID  /** Неверные аргументы или поврежденная куча */
+};
+
+/**
+ * @brief Обработчик превышения мягкого лимита
+ * @param[in] mapped Кол-во отображенных под кучу байт
+ * @param[in] arg Аргумент, переданный при регистрации
+*/
+typedef void (*heap_pressure_callback)( size_t mapped, void* arg );
+
+/**
+ * @brief Установка лимитов отображенной памяти
+ * @details При пересечении мягкого лимита вызываются обработчики и свободные страницы возвращаются ОС,
+ *          при достижении жесткого лимита куча не расширяется, а _malloc возвращает NULL с ошибкой HEAP_ERR_LIMIT.
+ *          Обработчики вызываются и при достижении жесткого лимита, но один раз, пока куча снова не расширится
+ *          или не уменьшится; после них выделение повторяется один раз
+ * @param[in] soft Мягкий лимит в байтах (0 - нет лимита)
+ * @param[in] hard Жесткий лимит в байтах (0 - нет лимита)
+*/
+void heap_set_limits( size_t soft, size_t hard );
+
+/**
+ * @brief Регистрация обработчика превышения мягкого лимита
+ * @details Обработчик вызывается вне захвата кучи и может освобождать память
+ * @param[in] cb Обработчик
+ * @param[in] arg Аргумент обработчика
+ * @return true, если обработчик зарегистрирован, иначе false
+*/
+bool heap_add_pressure_callback( heap_pressure_callback cb, void* arg );
+
+/**
+ * @brief Удаление всех обработчиков превышения мягкого лимита
+*/
+void heap_clear_pressure_callbacks( void );
+
+/**
+ * @brief Кол-во байт, отображенных под кучу
+ * @return Размер в байтах
+*/
+size_t heap_mapped_bytes( void );
+
+/**
+ * @brief Причина последней неудачи выделения памяти в текущем потоке
+ * @return Код ошибки
+*/
+enum heap_error heap_last_error( void );
+/**@}*/
+
+/**
+ * @defgroup MEM_MAINTAIN Обслуживание кучи
+*/
+/**@{*/
+/**
+ * @brief Включение отложенного режима, в котором _malloc и _free не сливают свободные блоки
+ * @details Если в списках свободных блоков нет подходящего, _malloc расширяет кучу, а не сливает блоки.
+ *          Сливать блоки на месте он начинает, только когда расширить кучу не удалось
+ * @param[in] deferred Флаг отложенного режима
+ * @param[in] on_pressure Функция, вызываемая при нехватке памяти в отложенном режиме, или NULL.
+ *            Вызывается в потоке выделения после снятия блокировки кучи, поэтому может обращаться к куче
+*/
+void heap_set_deferred( bool deferred, void (*on_pressure)( void ) );
+
+/**
+ * @brief Шаг обслуживания кучи: слияние свободных блоков и возврат страниц ОС
+ * @param[in] max_blocks Максимальное кол-во блоков, обрабатываемых за шаг
+ * @param[in] trim_threshold Минимальная вместимость свободного блока для возврата страниц (0 - не возвращать)
+ * @return true, если проход по куче завершен, иначе false
+*/
+bool heap_maintain( size_t max_blocks, size_t trim_threshold );
+
+/**
+ * @brief Обработчики перемещения блоков при уплотнении пула
+ * @details Вызываются под захватом кучи и не должны вызывать функции кучи
+*/
+struct compact_ops
+{
+  bool (*pinned)( void const* mem ); /** Проверка того, что занятый блок нельзя перемещать */
+  void (*moved)( void* mem );        /** Уведомление о новом адресе данных перемещенного блока */
+};
+
+/**
+ * @brief Шаг уплотнения пула: сдвиг незакрепленных занятых блоков к началу региона и возврат ОС свободного хвоста
+ * @details Шаг продолжает проход по пулу с блока, на котором остановился предыдущий, поэтому
+ *          проход по большому пулу завершается за несколько шагов с небольшим бюджетом
+ * @param[in] pool Пул, блоки которого можно перемещать
+ * @param[in] budget_ns Ограничение времени шага в наносекундах
+ * @param[in] ops Указатель на обработчики перемещения
+ * @return true, если проход по пулу завершен, иначе false
+*/
+bool heap_compact_step( enum heap_pool pool, uint64_t budget_ns, const struct compact_ops* ops );
+
+/**
+ * @brief Захват кучи, чтобы обойти ее блоки без гонок с другими потоками
+ * @details Пока куча захвачена, вызывать _malloc и _free нельзя
+*/
+void heap_lock( void );
+
+/**
+ * @brief Освобождение кучи после heap_lock
+*/
+void heap_unlock( void );
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,208 @@
+#ifndef _MEM_HPP_
+#define _MEM_HPP_
+
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+#include "mem.h"
+
+#define MEM_CPP_HEAP_SIZE (1 << 20) // Начальный размер кучи при ленивой инициализации
+
+
+/**
+ * @defgroup MEM_CPP Интеграция аллокатора с C++
+*/
+/**@{*/
+namespace mem
+{
+
+/**
+ * @brief Ленивая инициализация кучи при первом выделении памяти из C++
+ * @details Куча, уже инициализированная из C, используется как есть
+ * @return true, если куча начинается с HEAP_START, иначе false
+*/
+inline bool heap_ensure()
+{
+  static const bool ready = heap_init(MEM_CPP_HEAP_SIZE) == HEAP_START;
+  return ready;
+}
+
+/**
+ * @brief Выделение выровненной памяти из кучи
+ * @param[in] size Запрашиваемый размер в байтах
+ * @param[in] alignment Выравнивание (степень двойки)
+ * @return Указатель на данные или nullptr
+*/
+inline void* heap_allocate(std::size_t size, std::size_t alignment) noexcept
+{
+  if (!heap_ensure())
+    return nullptr;
+  return _malloc_aligned(alignment, size);
+}
+
+/**
+ * @brief Выделение памяти по правилам operator new
+ * @details При нехватке памяти вызывается установленный std::new_handler, после чего выделение
+ *          повторяется. Без обработчика выбрасывается std::bad_alloc
+ * @param[in] size Запрашиваемый размер в байтах
+ * @param[in] alignment Выравнивание (степень двойки)
+ * @return Указатель на данные
+*/
+inline void* heap_new(std::size_t size, std::size_t alignment)
+{
+  for (;;)
+  {
+    if (void* ptr = heap_allocate(size, alignment))
+      return ptr;
+    const std::new_handler handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+/**
+ * @brief Освобождение памяти с известным размером
+ * @details Флаг занятости хранится в заголовке блока, поэтому _free все равно обращается к нему.
+ *          Размер используется только для проверки в отладочной сборке
+ * @param[in] ptr Указатель на данные
+ * @param[in] size Размер, переданный при выделении
+*/
+inline void heap_deallocate(void* ptr, [[maybe_unused]] std::size_t size) noexcept
+{
+  assert(!ptr || _malloc_usable_size(ptr) >= size);
+  _free(ptr);
+}
+
+/**
+ * @brief Ресурс памяти std::pmr поверх кучи
+*/
+class heap_resource final : public std::pmr::memory_resource
+{
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    void* ptr = heap_allocate(bytes, alignment);
+    if (!ptr)
+      throw std::bad_alloc();
+    return ptr;
+  }
+
+  void do_deallocate(void* ptr, std::size_t bytes, std::size_t) override { heap_deallocate(ptr, bytes); }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return dynamic_cast<const heap_resource*>(&other) != nullptr; // Куча одна на процесс
+  }
+};
+
+/**
+ * @brief Общий экземпляр ресурса памяти
+ * @return Указатель на ресурс
+*/
+inline heap_resource* heap_memory_resource() noexcept
+{
+  static heap_resource resource;
+  return &resource;
+}
+
+/**
+ * @brief Аллокатор без состояния для контейнеров STL
+ * @tparam T Тип элементов
+*/
+template <class T>
+struct allocator
+{
+  using value_type = T;
+  using is_always_equal = std::true_type;
+
+  allocator() noexcept = default;
+
+  template <class U>
+  allocator(const allocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n)
+  {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) // Переполнение при расчете размера
+      throw std::bad_array_new_length();
+    void* ptr = heap_allocate(n * sizeof(T), alignof(T));
+    if (!ptr)
+      throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, std::size_t n) noexcept { heap_deallocate(ptr, n * sizeof(T)); }
+};
+
+template <class T, class U>
+bool operator==(const allocator<T>&, const allocator<U>&) noexcept { return true; }
+
+template <class T, class U>
+bool operator!=(const allocator<T>&, const allocator<U>&) noexcept { return false; }
+
+} // namespace mem
+/**@}*/
+
+/*  Замена глобальных operator new/delete. Макрос MEM_REPLACE_GLOBAL_NEW определяется
+    ровно в одной единице трансляции перед подключением заголовка */
+#ifdef MEM_REPLACE_GLOBAL_NEW
+
+void* operator new(std::size_t size) { return mem::heap_new(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  return mem::heap_new(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return mem::heap_new(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+  }
+  catch (const std::bad_alloc&)
+  {
+    return nullptr;
+  }
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return mem::heap_new(size, static_cast<std::size_t>(alignment));
+  }
+  catch (const std::bad_alloc&)
+  {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+  return operator new(size, alignment, tag);
+}
+
+void operator delete(void* ptr) noexcept { _free(ptr); }
+void operator delete(void* ptr, std::size_t size) noexcept { mem::heap_deallocate(ptr, size); }
+void operator delete(void* ptr, std::align_val_t) noexcept { _free(ptr); }
+void operator delete(void* ptr, std::size_t size, std::align_val_t) noexcept { mem::heap_deallocate(ptr, size); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { _free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { _free(ptr); }
+
+void operator delete[](void* ptr) noexcept { _free(ptr); }
+void operator delete[](void* ptr, std::size_t size) noexcept { mem::heap_deallocate(ptr, size); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { _free(ptr); }
+void operator delete[](void* ptr, std::size_t size, std::align_val_t) noexcept { mem::heap_deallocate(ptr, size); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { _free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { _free(ptr); }
+
+#endif // MEM_REPLACE_GLOBAL_NEW
+
+#endif // !_MEM_HPP_
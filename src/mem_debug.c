@@ -1,6 +1,13 @@
+#define _DEFAULT_SOURCE
+
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
 
+#include "mem.h"
 #include "mem_debug.h"
 
 
@@ -27,6 +34,75 @@ void debug_heap( FILE* f,  void const* ptr )
     debug_struct_info( f, header );
 }
 
+/**
+ * @brief Запись буфера в файл с дозаписью при неполной записи
+ * @param[in] fd Дескриптор файла
+ * @param[in] buf Указатель на буфер
+ * @param[in] size Размер буфера в байтах
+ * @return true, если буфер записан полностью, иначе false
+*/
+static bool write_all( int fd, const uint8_t* buf, size_t size )
+{
+  while (size)
+  {
+    const ssize_t written = write(fd, buf, size);
+    if (written <= 0)
+      return false;
+    buf += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool debug_heap_snapshot( int fd, void const* ptr )
+{
+  heap_lock();
+
+  struct snapshot_header header = { .magic = SNAPSHOT_MAGIC, .version = SNAPSHOT_VERSION,
+                                    .header_size = offsetof(struct block_header, contents) };
+  void const* region_end = NULL;
+  for (struct block_header const* b = ptr; b; b = b->next) // Подсчет участков и блоков для расчета размера буфера
+  {
+    header.regions += (void const*) b != region_end;
+    header.blocks++;
+    region_end = b->contents + b->capacity.bytes;
+  }
+
+  const size_t size = sizeof(header) + header.regions * sizeof(struct snapshot_region)
+                    + header.blocks * sizeof(struct snapshot_block);
+  uint8_t* buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED)
+  {
+    heap_unlock();
+    return false;
+  }
+
+  memcpy(buf, &header, sizeof(header));
+  struct snapshot_region* regions = (struct snapshot_region*) (buf + sizeof(header));
+  struct snapshot_block* blocks = (struct snapshot_block*) (regions + header.regions);
+  struct snapshot_region* region = regions - 1;
+  region_end = NULL;
+  for (struct block_header const* b = ptr; b; b = b->next, ++blocks)
+  {
+    if ((void const*) b != region_end) // Начало нового участка
+      *++region = (struct snapshot_region) { .addr = (uintptr_t) b };
+    *blocks = (struct snapshot_block) {
+      .offset = (uintptr_t) b - region->addr,
+      .capacity = b->capacity.bytes,
+      .is_free = b->is_free,
+      .is_clean = b->is_free && b->dirty_bytes == 0
+    };
+    region->blocks++;
+    region_end = b->contents + b->capacity.bytes;
+    region->size = (uintptr_t) region_end - region->addr;
+  }
+  heap_unlock();
+
+  const bool res = write_all(fd, buf, size);
+  munmap(buf, size);
+  return res;
+}
+
 void debug_block(struct block_header* b, const char* fmt, ... ) 
 {
   #ifdef DEBUG
@@ -6,11 +6,49 @@
 
 #define DEBUG_FIRST_BYTES 4 // Кол-во байт данных для вывода
 
+#define SNAPSHOT_MAGIC "HSNP" // Сигнатура файла снимка кучи
+#define SNAPSHOT_VERSION 1    // Версия формата снимка
+
 
 /**
  * @defgroup MEM_DEBUG Функции для вывода информации о работе с памятью
 */
 /**@{*/
+/**
+ * @brief Заголовок снимка кучи
+ * @details За заголовком следуют regions структур snapshot_region и blocks структур snapshot_block
+*/
+struct snapshot_header
+{
+  char magic[4];        /** Сигнатура SNAPSHOT_MAGIC */
+  uint32_t version;     /** Версия формата */
+  uint64_t header_size; /** Размер заголовка блока в байтах */
+  uint64_t regions;     /** Кол-во непрерывных участков памяти */
+  uint64_t blocks;      /** Кол-во блоков */
+};
+
+/**
+ * @brief Непрерывный участок памяти в снимке
+*/
+struct snapshot_region
+{
+  uint64_t addr;   /** Адрес начала участка */
+  uint64_t size;   /** Размер участка в байтах */
+  uint64_t blocks; /** Кол-во блоков в участке */
+};
+
+/**
+ * @brief Блок в снимке
+*/
+struct snapshot_block
+{
+  uint64_t offset;   /** Смещение заголовка блока от начала участка */
+  uint64_t capacity; /** Вместимость блока в байтах */
+  uint8_t is_free;   /** Флаг свободного блока */
+  uint8_t is_clean;  /** Флаг свободного блока, содержимое которого обнулено */
+  uint8_t reserved[6];
+};
+
 /**
  * @brief Вывод информации об блоке памяти в файл
  * @param[in] f Указатель на открытый файл
@@ -25,6 +63,16 @@ void debug_struct_info( FILE* f, void const* address );
 */
 void debug_heap( FILE* f,  void const* ptr );
 
+/**
+ * @brief Запись двоичного снимка кучи в файл одним вызовом write
+ * @details Снимок охватывает одну цепочку блоков. Пулы из mem.h пишутся отдельными снимками,
+ *          ptr для каждого из них возвращает heap_pool_start
+ * @param[in] fd Дескриптор открытого на запись файла
+ * @param[in] ptr Указатель на адрес первого блока
+ * @return true, если снимок записан полностью, иначе false
+*/
+bool debug_heap_snapshot( int fd, void const* ptr );
+
 /**
  * @brief Вывод инфморации об блока памяти с загловком в stderr
  * @param[in] b Указатель структуру блока памяти
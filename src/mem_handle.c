@@ -0,0 +1,163 @@
+#define _DEFAULT_SOURCE
+
+#include <string.h>
+
+#include <sys/mman.h>
+
+#include "mem.h"
+#include "mem_handle.h"
+#include "mem_internals.h"
+
+#define HANDLE_TABLE_MIN 1024 // Начальное кол-во записей в таблице дескрипторов
+#define HANDLE_HEADER offsetof(struct block_header, contents)
+// Номер дескриптора и выравнивание: блоки пула перемещаемых блоков начинаются на границе BLOCK_ALIGNMENT
+#define HANDLE_PREFIX ((HANDLE_HEADER + sizeof(uint64_t) + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT - HANDLE_HEADER)
+
+/**
+ * @brief Запись таблицы дескрипторов
+*/
+struct handle_entry
+{
+  uint8_t* block;     /** Начало данных блока (с номером дескриптора) или NULL для свободной записи */
+  uint32_t locks;     /** Кол-во незавершенных закреплений */
+  uint32_t next_free; /** Номер следующей свободной записи */
+};
+
+static struct handle_entry* table = NULL; // Таблица дескрипторов, номер дескриптора - индекс записи
+static uint32_t table_size = 0;           // Кол-во записей в таблице
+static uint32_t table_used = 1;           // Кол-во использованных записей (нулевая запись не используется)
+static uint32_t free_head = 0;            // Первая освобожденная запись
+
+extern inline bool hnd_is_invalid( hnd_t h );
+
+/**
+ * @brief Расширение таблицы дескрипторов вдвое
+ * @details Таблица размещается через mmap, чтобы не обращаться к куче под ее захватом
+ * @return true, если таблица расширена, иначе false
+*/
+static bool table_grow( void )
+{
+  const uint32_t size = table_size ? table_size * 2 : HANDLE_TABLE_MIN;
+  struct handle_entry* grown = mmap(NULL, size * sizeof(*grown), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (grown == MAP_FAILED)
+    return false;
+  if (table)
+  {
+    memcpy(grown, table, table_size * sizeof(*table));
+    munmap(table, table_size * sizeof(*table));
+  }
+  table = grown;
+  table_size = size;
+  return true;
+}
+
+/**
+ * @brief Поиск записи действительного дескриптора
+ * @param[in] h Дескриптор
+ * @return Указатель на запись или NULL
+*/
+static struct handle_entry* entry_of( hnd_t h )
+{
+  if (h.id == 0 || h.id >= table_used || !table[h.id].block)
+    return NULL;
+  return &table[h.id];
+}
+
+/**
+ * @brief Номер дескриптора, записанный в начале данных блока
+ * @param[in] mem Указатель на данные блока
+ * @return Номер дескриптора
+*/
+static uint32_t block_handle( void const* mem )
+{
+  uint32_t id;
+  memcpy(&id, mem, sizeof(id));
+  return id;
+}
+
+/**
+ * @brief Проверка того, что блок нельзя перемещать
+ * @details Блок без действительной записи (только что выделен или уже освобожден) тоже считается закрепленным
+*/
+static bool handle_pinned( void const* mem )
+{
+  const uint32_t id = block_handle(mem);
+  return id == 0 || id >= table_used || table[id].block != mem || table[id].locks > 0;
+}
+
+/**
+ * @brief Обновление адреса блока после перемещения
+*/
+static void handle_moved( void* mem ) { table[block_handle(mem)].block = mem; }
+
+static const struct compact_ops HANDLE_COMPACT_OPS = { .pinned = handle_pinned, .moved = handle_moved };
+
+hnd_t hnd_alloc( size_t size )
+{
+  if (size > SIZE_MAX - HANDLE_PREFIX)
+    return HND_INVALID;
+  uint8_t* block = _malloc_ex(HANDLE_PREFIX + size, MEM_HINT_MOVABLE); // Перед данными хранится номер дескриптора
+  if (!block)
+    return HND_INVALID;
+
+  heap_lock();
+  uint32_t id = free_head;
+  if (id) // Повторное использование освобожденной записи
+    free_head = table[id].next_free;
+  else if (table_used < table_size || table_grow())
+    id = table_used++;
+  if (id)
+  {
+    table[id] = (struct handle_entry) { .block = block };
+    memcpy(block, &id, sizeof(id));
+  }
+  heap_unlock();
+
+  if (!id) // Таблица не расширилась
+  {
+    _free(block);
+    return HND_INVALID;
+  }
+  return (hnd_t) {id};
+}
+
+void* hnd_lock( hnd_t h )
+{
+  heap_lock();
+  struct handle_entry* entry = entry_of(h);
+  void* mem = NULL;
+  if (entry)
+  {
+    entry->locks++;
+    mem = entry->block + HANDLE_PREFIX;
+  }
+  heap_unlock();
+  return mem;
+}
+
+void hnd_unlock( hnd_t h )
+{
+  heap_lock();
+  struct handle_entry* entry = entry_of(h);
+  if (entry && entry->locks)
+    entry->locks--;
+  heap_unlock();
+}
+
+void hnd_free( hnd_t h )
+{
+  heap_lock();
+  struct handle_entry* entry = entry_of(h);
+  uint8_t* block = NULL;
+  if (entry)
+  {
+    block = entry->block;
+    *entry = (struct handle_entry) { .next_free = free_head };
+    free_head = h.id;
+  }
+  heap_unlock();
+
+  _free(block); // Блок без записи считается закрепленным и не переместится до освобождения
+}
+
+bool hnd_compact_step( uint64_t budget_ns ) { return heap_compact_step(HEAP_POOL_MOVABLE, budget_ns, &HANDLE_COMPACT_OPS); }
@@ -0,0 +1,65 @@
+#ifndef _MEM_HANDLE_H_
+#define _MEM_HANDLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @defgroup MEM_HANDLE Перемещаемые блоки, доступные через дескрипторы
+*/
+/**@{*/
+/**
+ * @brief Дескриптор перемещаемого блока
+*/
+typedef struct { uint32_t id; } hnd_t;
+
+/**
+ * @brief Недействительный дескриптор
+*/
+static const hnd_t HND_INVALID = {0};
+
+/**
+ * @brief Проверка дескриптора на недействительность
+ * @param[in] h Дескриптор
+ * @return true, если дескриптор недействителен, иначе false
+*/
+inline bool hnd_is_invalid( hnd_t h ) { return h.id == 0; }
+
+/**
+ * @brief Выделение перемещаемого блока
+ * @param[in] size Запрашиваемый размер в байтах
+ * @return Дескриптор блока или HND_INVALID
+*/
+hnd_t hnd_alloc( size_t size );
+
+/**
+ * @brief Закрепление блока на месте и получение адреса его данных
+ * @details Пока блок закреплен, уплотнение его не перемещает. Вызовы можно вкладывать
+ * @param[in] h Дескриптор блока
+ * @return Указатель на данные, выровненный на 16 байт, или NULL для недействительного дескриптора
+*/
+void* hnd_lock( hnd_t h );
+
+/**
+ * @brief Снятие закрепления блока, после которого адрес его данных может измениться
+ * @param[in] h Дескриптор блока
+*/
+void hnd_unlock( hnd_t h );
+
+/**
+ * @brief Освобождение перемещаемого блока
+ * @param[in] h Дескриптор блока
+*/
+void hnd_free( hnd_t h );
+
+/**
+ * @brief Шаг уплотнения пула перемещаемых блоков
+ * @details Незакрепленные блоки сдвигаются к началу региона, освободившиеся в конце региона страницы возвращаются ОС
+ * @param[in] budget_ns Ограничение времени шага в наносекундах
+ * @return true, если пул уплотнен полностью, иначе false
+*/
+bool hnd_compact_step( uint64_t budget_ns );
+/**@}*/
+
+#endif // !_MEM_HANDLE_H_
@@ -6,6 +6,13 @@
 #include <stddef.h>
 
 #define REGION_MIN_SIZE (2 * 4096) // Минимальный размер региона
+#define BLOCK_POOL_BITS 2           // Кол-во бит под номер пула в заголовке блока
+#define BLOCK_ALIGNMENT 16          // Выравнивание, которое сохраняется для следующего блока при выровненном выделении
+
+#define INDEX_SUBCLASS_BITS 2                               // Кол-во бит для деления степени двойки на подклассы
+#define INDEX_CLASSES (64 << INDEX_SUBCLASS_BITS)           // Кол-во классов размеров свободных блоков
+#define INDEX_WORDS (INDEX_CLASSES / 64)                    // Кол-во 64-битных слов битовой карты классов
+#define INDEX_SCAN_LIMIT 8                                  // Кол-во блоков, просматриваемых в списке класса самого запроса
 
 /**
  * @defgroup MEM_INTERNALS Внутренние свойства памяти
@@ -49,7 +56,10 @@ typedef struct { size_t bytes; } block_size;
 struct block_header {
   struct block_header* next; /** Указатель на следующий блок памяти */
   block_capacity capacity;   /** Вместимость блока в байтах */
-  bool is_free;              /** Флаг занятости блока */
+  size_t dirty_bytes;        /** Кол-во байт в начале данных свободного блока, которые могли быть изменены (остальные заполнены нулями) */
+  bool is_free : 1;          /** Флаг занятости блока */
+  unsigned pool : BLOCK_POOL_BITS; /** Пул, которому принадлежит блок */
+  bool prev_free : 1;        /** Флаг свободного блока, вплотную предшествующего этому в памяти */
   uint8_t contents[];        /** Данные */
 };
 
@@ -60,6 +70,43 @@ struct block_header {
 */
 inline block_size size_from_capacity( block_capacity cap ) { return (block_size) {cap.bytes + offsetof( struct block_header, contents ) }; }
 
+/**
+ * @brief Связи свободного блока в списке его класса
+ * @details Хранятся в последних байтах данных свободного блока и обнуляются при исключении блока из списка,
+ *          поэтому не входят в грязную часть и не попадают в данные занятого блока
+*/
+struct free_links
+{
+  struct block_header* prev;  /** Предыдущий блок списка или NULL */
+  struct block_header* next;  /** Следующий блок списка или NULL */
+  struct block_header* block; /** Сам свободный блок: по нему следующий в памяти блок находит начало предыдущего */
+};
+
+/**
+ * @brief Сводка о свободных блоках кучи
+ * @details Свободные блоки каждого класса связаны в список, бит класса в words установлен, если список непуст,
+ *          бит слова в summary - если в слове есть хотя бы один установленный бит
+*/
+struct free_index
+{
+  uint64_t summary;                           /** Битовая карта непустых слов */
+  uint64_t words[INDEX_WORDS];                /** Битовая карта непустых классов */
+  struct block_header* lists[INDEX_CLASSES];  /** Первые блоки списков свободных блоков каждого класса */
+  size_t blocks;                              /** Общее кол-во свободных блоков */
+  size_t bytes;                               /** Суммарная вместимость свободных блоков */
+};
+
+/**
+ * @brief Состояние пула: отдельной цепочки регионов со своей сводкой свободных блоков
+*/
+struct heap_pool_state
+{
+  struct block_header* head; /** Первый блок пула или NULL, если пул еще не создан */
+  struct block_header* tail;           /** Последний блок пула */
+  struct block_header* compact_cursor; /** Блок, с которого продолжится уплотнение пула, или NULL */
+  struct free_index index;             /** Сводка о свободных блоках пула */
+};
+
 /**
  *  @brief Расчет вместимости блока из его размера
  *  @param[in] sz Размер блока в байтах
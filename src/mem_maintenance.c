@@ -0,0 +1,139 @@
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mem.h"
+#include "mem_maintenance.h"
+
+#define NSEC_IN_MSEC 1000000L    // Кол-во наносекунд в миллисекунде
+#define NSEC_IN_SEC 1000000000L  // Кол-во наносекунд в секунде
+
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER; // Блокировка состояния потока
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;    // Сигнал потоку обслуживания
+static pthread_t worker;                                         // Поток обслуживания
+static bool worker_running = false;                              // Флаг работающего потока
+static bool worker_stop = false;                                 // Запрос на остановку потока
+static bool worker_wake = false;                                 // Запрос на внеочередной проход
+static struct maintenance_config worker_config;                  // Текущие настройки
+
+/**
+ * @brief Расчет момента окончания ожидания
+ * @param[in] interval_ms Период ожидания в миллисекундах
+ * @return Абсолютное время окончания ожидания
+*/
+static struct timespec deadline_after( unsigned interval_ms )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += (long) (interval_ms % 1000) * NSEC_IN_MSEC;
+  ts.tv_sec += interval_ms / 1000 + ts.tv_nsec / NSEC_IN_SEC;
+  ts.tv_nsec %= NSEC_IN_SEC;
+  return ts;
+}
+
+/**
+ * @brief Проверка настроек: нулевой шаг или период заставляют поток крутиться вхолостую
+ * @param[in] config Указатель на настройки
+ * @return true, если настройки допустимы, иначе false
+*/
+static bool config_valid( const struct maintenance_config* config )
+{
+  return config && config->step_blocks > 0 && config->interval_ms > 0;
+}
+
+/**
+ * @brief Основной цикл потока обслуживания
+ * @param[in] arg Не используется
+ * @return NULL
+*/
+static void* worker_loop( void* arg )
+{
+  (void) arg;
+  pthread_mutex_lock(&worker_mutex);
+  while (!worker_stop)
+  {
+    const struct maintenance_config config = worker_config;
+    pthread_mutex_unlock(&worker_mutex);
+
+    while (!heap_maintain(config.step_blocks, config.trim_threshold)) // Проход по куче небольшими шагами
+      if (__atomic_load_n(&worker_stop, __ATOMIC_RELAXED))
+        break;
+
+    pthread_mutex_lock(&worker_mutex);
+    const struct timespec deadline = deadline_after(worker_config.interval_ms);
+    while (!worker_stop && !worker_wake) // Ожидание следующего прохода или нехватки памяти
+      if (pthread_cond_timedwait(&worker_cond, &worker_mutex, &deadline))
+        break;
+    worker_wake = false;
+  }
+  pthread_mutex_unlock(&worker_mutex);
+  return NULL;
+}
+
+bool maintenance_start( const struct maintenance_config* config )
+{
+  if (config && !config_valid(config))
+    return false;
+  pthread_mutex_lock(&worker_mutex);
+  if (worker_running) // Поток уже запущен
+  {
+    pthread_mutex_unlock(&worker_mutex);
+    return false;
+  }
+  worker_config = config ? *config : MAINTENANCE_DEFAULT;
+  worker_stop = false;
+  worker_wake = false;
+  worker_running = pthread_create(&worker, NULL, worker_loop, NULL) == 0;
+  pthread_mutex_unlock(&worker_mutex);
+
+  if (worker_running)
+    heap_set_deferred(true, maintenance_wake);
+  return worker_running;
+}
+
+void maintenance_stop( void )
+{
+  pthread_mutex_lock(&worker_mutex);
+  if (!worker_running) // Поток не запущен
+  {
+    pthread_mutex_unlock(&worker_mutex);
+    return;
+  }
+  pthread_mutex_unlock(&worker_mutex);
+
+  heap_set_deferred(false, NULL); // Сначала выделения перестают будить поток
+
+  pthread_mutex_lock(&worker_mutex);
+  __atomic_store_n(&worker_stop, true, __ATOMIC_RELAXED);
+  pthread_cond_signal(&worker_cond);
+  pthread_mutex_unlock(&worker_mutex);
+
+  pthread_join(worker, NULL);
+  pthread_mutex_lock(&worker_mutex);
+  worker_running = false;
+  pthread_mutex_unlock(&worker_mutex);
+
+  heap_maintain(SIZE_MAX, 0); // Завершение текущего прохода
+  heap_maintain(SIZE_MAX, 0); // Полный проход, чтобы оставить кучу слитой, как в обычном режиме
+}
+
+bool maintenance_tune( const struct maintenance_config* config )
+{
+  if (!config_valid(config))
+    return false;
+  pthread_mutex_lock(&worker_mutex);
+  worker_config = *config;
+  pthread_cond_signal(&worker_cond);
+  pthread_mutex_unlock(&worker_mutex);
+  return true;
+}
+
+void maintenance_wake( void )
+{
+  pthread_mutex_lock(&worker_mutex);
+  worker_wake = true;
+  pthread_cond_signal(&worker_cond);
+  pthread_mutex_unlock(&worker_mutex);
+}
@@ -0,0 +1,56 @@
+#ifndef _MEM_MAINTENANCE_H_
+#define _MEM_MAINTENANCE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @defgroup MEM_MAINTENANCE Фоновое обслуживание кучи
+*/
+/**@{*/
+/**
+ * @brief Настройки фонового обслуживания
+*/
+struct maintenance_config
+{
+  unsigned interval_ms;  /** Период между проходами по куче в миллисекундах */
+  size_t step_blocks;    /** Кол-во блоков, обрабатываемых за один захват кучи */
+  size_t trim_threshold; /** Минимальная вместимость свободного блока для возврата страниц ОС (0 - не возвращать) */
+};
+
+/**
+ * @brief Настройки по умолчанию
+*/
+static const struct maintenance_config MAINTENANCE_DEFAULT = {
+  .interval_ms = 10,
+  .step_blocks = 64,
+  .trim_threshold = 64 * 1024
+};
+
+/**
+ * @brief Запуск фонового потока обслуживания и перевод кучи в отложенный режим
+ * @details В отложенном режиме _malloc и _free не сливают блоки, а подходящий блок ищется по спискам классов
+ * @param[in] config Указатель на настройки или NULL для настроек по умолчанию
+ * @return true, если поток запущен, иначе false (в том числе при недопустимых настройках)
+*/
+bool maintenance_start( const struct maintenance_config* config );
+
+/**
+ * @brief Остановка фонового потока и возврат кучи в обычный режим
+*/
+void maintenance_stop( void );
+
+/**
+ * @brief Изменение настроек работающего фонового обслуживания
+ * @param[in] config Указатель на новые настройки
+ * @return true, если настройки приняты, иначе false
+*/
+bool maintenance_tune( const struct maintenance_config* config );
+
+/**
+ * @brief Внеочередной запуск прохода по куче
+*/
+void maintenance_wake( void );
+/**@}*/
+
+#endif // !_MEM_MAINTENANCE_H_
@@ -6,9 +6,15 @@
 
 #define _DEFAULT_SOURCE
 
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
 #include "util.h"
 #include "mem.h"
 #include "mem_debug.h"
+#include "mem_handle.h"
+#include "mem_maintenance.h"
 
 #define SPLIT_LINE "----------------------------------\n"
 #define HEAP_INIT_SIZE 10000
@@ -60,6 +66,22 @@ void all_test()
     extend_heap_test();
     debug(SPLIT_LINE);
     continue_heap_test();
+    debug(SPLIT_LINE);
+    deferred_merge_test();
+    debug(SPLIT_LINE);
+    calloc_test();
+    debug(SPLIT_LINE);
+    aligned_alloc_test();
+    debug(SPLIT_LINE);
+    snapshot_test();
+    debug(SPLIT_LINE);
+    limits_test();
+    debug(SPLIT_LINE);
+    lifetime_hint_test();
+    debug(SPLIT_LINE);
+    handle_compaction_test();
+    debug(SPLIT_LINE);
+    free_index_test();
 }
 
 void simple_alloc_test()
@@ -73,6 +95,9 @@ void simple_alloc_test()
 
     uint32_t* arr = malloc_test(sizeof(uint32_t)*100, test_num, heap, "массив uint32_t размера 100");
 
+    if (heap_init(HEAP_INIT_SIZE) != heap || _malloc_usable_size(arr) < sizeof(uint32_t)*100)
+        err("\nОшибка: повторная инициализация изменила кучу. Тест %d не пройден\n", test_num);
+
     debug("\nТест %d пройден\n\n", test_num);
 
     _free(arr);
@@ -153,6 +178,8 @@ void continue_heap_test()
     void* split_mem = make_mmap((void*) (header->contents + header->capacity.bytes), test_num);
     
     int8_t* arr = malloc_test(sizeof(uint8_t)*1000000, test_num, heap, "массив uint8_t размера 1000000");
+    if (!heap_owns(arr) || heap_owns(split_mem))
+        err("\nОшибка: неверно определена принадлежность памяти куче. Тест %d не пройден\n", test_num);
     _free(arr);
 
     debug("\nКуча после освобождения памяти:\n");
@@ -164,6 +191,434 @@ void continue_heap_test()
     heap_kill(split_mem, 200000);
 }
 
+static size_t deferred_hook_calls = 0; // Кол-во вызовов обработчика нехватки памяти в отложенном режиме
+
+/**
+ * @brief Обработчик нехватки памяти в отложенном режиме для теста
+ * @details Обращается к куче: под ее блокировкой такой вызов бы завис
+*/
+static void deferred_hook(void)
+{
+    if (heap_mapped_bytes() > 0)
+        deferred_hook_calls++;
+}
+
+void deferred_merge_test()
+{
+    static const uint16_t test_num = 6;
+    debug("Тест %d. Отложенное слияние свободных блоков\n", test_num);
+
+    void* heap = heap_init_test(HEAP_INIT_SIZE, test_num);
+    heap_set_deferred(true, deferred_hook);
+
+    uint16_t* data = malloc_test(sizeof(uint16_t), test_num, heap, "uint16_t");
+    uint32_t* arr = malloc_test(sizeof(uint32_t)*100, test_num, heap, "массив uint32_t размера 100");
+    uint8_t* arr2 = malloc_test(sizeof(uint8_t)*100, test_num, heap, "массив uint8_t размера 100");
+
+    free_test(arr2, heap, "массив uint8_t");
+    free_test(arr, heap, "массив uint32_t");
+
+    struct block_header* header = (struct block_header*) HEAP_START;
+    if (header->next->next == NULL)
+        err("\nОшибка: блоки слиты до обслуживания кучи. Тест %d не пройден\n", test_num);
+
+    debug("\nВыделение памяти под массив uint8_t размера 12000, которому не хватает места без слияния. Результат:\n");
+    uint8_t* big = _malloc(sizeof(uint8_t)*12000);
+    if (big == NULL)
+        err("\nОшибка: Не удалось выделить память. Тест %d не пройден\n", test_num);
+    debug_heap(stderr, heap);
+    if (deferred_hook_calls != 1)
+        err("\nОшибка: обработчик нехватки памяти не вызван. Тест %d не пройден\n", test_num);
+    if (!header->next->is_free || header->next->capacity.bytes != sizeof(uint32_t)*100)
+        err("\nОшибка: блоки слиты при выделении в отложенном режиме. Тест %d не пройден\n", test_num);
+    _free(big);
+
+    debug("\nОбслуживание кучи. Результат:\n");
+    while (!heap_maintain(SIZE_MAX, 0));
+    debug_heap(stderr, heap);
+    if (header->next->next != NULL)
+        err("\nОшибка: свободные блоки не слиты при обслуживании кучи. Тест %d не пройден\n", test_num);
+
+    const struct maintenance_config idle = { .interval_ms = 10, .step_blocks = 0 };
+    if (maintenance_start(&idle) || maintenance_tune(&idle))
+        err("\nОшибка: приняты настройки с нулевым шагом обслуживания. Тест %d не пройден\n", test_num);
+
+    debug("\nТест %d пройден\n\n", test_num);
+
+    heap_set_deferred(false, NULL);
+    _free(data);
+
+    heap_kill(heap, HEAP_INIT_SIZE);
+}
+
+void calloc_test()
+{
+    static const uint16_t test_num = 7;
+    debug("Тест %d. Выделение обнуленной памяти\n", test_num);
+
+    void* heap = heap_init_test(HEAP_INIT_SIZE, test_num);
+
+    uint8_t* arr = malloc_test(sizeof(uint8_t)*1000, test_num, heap, "массив uint8_t размера 1000");
+    memset(arr, 0xAB, sizeof(uint8_t)*1000);
+    free_test(arr, heap, "массив uint8_t");
+
+    debug("\nВыделение обнуленной памяти под массив uint32_t размера 2000. Результат:\n");
+    uint32_t* zeros = _calloc(2000, sizeof(uint32_t));
+    if (zeros == NULL)
+        err("\nОшибка: Не удалось выделить память. Тест %d не пройден\n", test_num);
+    debug_heap(stderr, heap);
+    for (size_t i = 0; i < 2000; ++i)
+        if (zeros[i] != 0)
+            err("\nОшибка: память не обнулена. Тест %d не пройден\n", test_num);
+
+    debug("\nВыделение обнуленной памяти под массив uint8_t размера 20000 с расширением кучи. Результат:\n");
+    uint8_t* grown = _calloc(20000, sizeof(uint8_t));
+    if (grown == NULL)
+        err("\nОшибка: Не удалось выделить память. Тест %d не пройден\n", test_num);
+    debug_heap(stderr, heap);
+    for (size_t i = 0; i < 20000; ++i)
+        if (grown[i] != 0)
+            err("\nОшибка: память не обнулена. Тест %d не пройден\n", test_num);
+    struct block_header* tail = ((struct block_header*) (grown - offsetof(struct block_header, contents)))->next;
+    if (tail == NULL || !tail->is_free || tail->dirty_bytes != 0)
+        err("\nОшибка: свежая память кучи помечена как грязная. Тест %d не пройден\n", test_num);
+
+    if (_calloc(SIZE_MAX / 2, 4) != NULL || _calloc(1, SIZE_MAX - 8) != NULL)
+        err("\nОшибка: переполнение размера не обнаружено. Тест %d не пройден\n", test_num);
+    if (_malloc_ex(SIZE_MAX - 20, MEM_HINT_NONE) != NULL || heap_last_error() != HEAP_ERR_INVALID)
+        err("\nОшибка: переполнение размера не обнаружено. Тест %d не пройден\n", test_num);
+
+    debug("\nТест %d пройден\n\n", test_num);
+
+    _free(grown);
+    _free(zeros);
+
+    heap_kill(heap, HEAP_INIT_SIZE);
+}
+
+void aligned_alloc_test()
+{
+    static const uint16_t test_num = 8;
+    debug("Тест %d. Выделение выровненной памяти\n", test_num);
+
+    void* heap = heap_init_test(HEAP_INIT_SIZE, test_num);
+
+    uint16_t* data = malloc_test(sizeof(uint16_t), test_num, heap, "uint16_t");
+
+    debug("\nВыделение памяти под массив uint64_t размера 100 с выравниванием 64. Результат:\n");
+    uint64_t* arr = _malloc_aligned(64, sizeof(uint64_t)*100);
+    if (arr == NULL)
+        err("\nОшибка: Не удалось выделить память. Тест %d не пройден\n", test_num);
+    debug_heap(stderr, heap);
+    if ((uintptr_t) arr % 64 != 0)
+        err("\nОшибка: память не выровнена. Тест %d не пройден\n", test_num);
+    if (_malloc_usable_size(arr) < sizeof(uint64_t)*100)
+        err("\nОшибка: вместимость блока меньше запрошенной. Тест %d не пройден\n", test_num);
+
+    debug("\nТест %d пройден\n\n", test_num);
+
+    _free(arr);
+    _free(data);
+
+    heap_kill(heap, HEAP_INIT_SIZE);
+}
+
+void snapshot_test()
+{
+    static const uint16_t test_num = 9;
+    debug("Тест %d. Двоичный снимок кучи\n", test_num);
+
+    void* heap = heap_init_test(HEAP_INIT_SIZE, test_num);
+
+    uint16_t* data = malloc_test(sizeof(uint16_t), test_num, heap, "uint16_t");
+    uint32_t* arr = malloc_test(sizeof(uint32_t)*100, test_num, heap, "массив uint32_t размера 100");
+    uint8_t* arr2 = malloc_test(sizeof(uint8_t)*100, test_num, heap, "массив uint8_t размера 100");
+    free_test(arr, heap, "массив uint32_t");
+
+    FILE* f = tmpfile();
+    if (f == NULL || !debug_heap_snapshot(fileno(f), heap))
+        err("\nОшибка: не удалось записать снимок кучи. Тест %d не пройден\n", test_num);
+
+    struct {
+        struct snapshot_header header;
+        struct snapshot_region region;
+        struct snapshot_block blocks[4];
+    } snapshot;
+    rewind(f);
+    if (fread(&snapshot, sizeof(snapshot), 1, f) != 1 || fgetc(f) != EOF)
+        err("\nОшибка: размер снимка не совпадает с кучей. Тест %d не пройден\n", test_num);
+    fclose(f);
+
+    debug("\nСнимок кучи: участков %" PRIu64 ", блоков %" PRIu64 "\n", snapshot.header.regions, snapshot.header.blocks);
+    if (snapshot.header.regions != 1 || snapshot.header.blocks != 4 || snapshot.region.addr != (uintptr_t) heap)
+        err("\nОшибка: неверный заголовок снимка. Тест %d не пройден\n", test_num);
+    if (snapshot.blocks[0].is_free || !snapshot.blocks[1].is_free || snapshot.blocks[1].capacity != sizeof(uint32_t)*100)
+        err("\nОшибка: неверные блоки в снимке. Тест %d не пройден\n", test_num);
+
+    debug("\nТест %d пройден\n\n", test_num);
+
+    _free(arr2);
+    _free(data);
+
+    heap_kill(heap, HEAP_INIT_SIZE);
+}
+
+/**
+ * @brief Обработчик превышения лимита для теста
+ * @param[in] mapped Кол-во отображенных под кучу байт
+ * @param[out] arg Указатель на счетчик вызовов
+*/
+static void pressure_counter(size_t mapped, void* arg)
+{
+    debug("\nПревышен лимит: отображено %zu байт\n", mapped);
+    ++*(size_t*) arg;
+}
+
+/**
+ * @brief Обработчик нехватки памяти для теста: освобождает удерживаемый блок
+ * @param[in] mapped Кол-во отображенных под кучу байт
+ * @param[out] arg Указатель на указатель на блок
+*/
+static void pressure_release(size_t mapped, void* arg)
+{
+    debug("Освобождение удерживаемого блока: отображено %zu байт\n", mapped);
+    _free(*(void**) arg);
+    *(void**) arg = NULL;
+}
+
+void limits_test()
+{
+    static const uint16_t test_num = 10;
+    debug("Тест %d. Мягкий и жесткий лимиты памяти\n", test_num);
+
+    size_t pressure_calls = 0;
+    heap_set_limits(16384, 32768);
+    heap_add_pressure_callback(pressure_counter, &pressure_calls);
+
+    void* heap = heap_init_test(HEAP_INIT_SIZE, test_num);
+
+    uint32_t* arr = malloc_test(sizeof(uint32_t)*3500, test_num, heap, "массив uint32_t размера 3500");
+    if (pressure_calls != 1)
+        err("\nОшибка: обработчик мягкого лимита не вызван. Тест %d не пройден\n", test_num);
+
+    debug("\nВыделение памяти под массив uint8_t размера 20000 сверх жесткого лимита\n");
+    if (_malloc(sizeof(uint8_t)*20000) != NULL || heap_last_error() != HEAP_ERR_LIMIT)
+        err("\nОшибка: жесткий лимит не соблюден. Тест %d не пройден\n", test_num);
+    debug("Отображено %zu байт\n", heap_mapped_bytes());
+    if (pressure_calls != 2)
+        err("\nОшибка: обработчик не вызван при достижении жесткого лимита. Тест %d не пройден\n", test_num);
+
+    debug("\nПовторное выделение сверх жесткого лимита\n");
+    if (_malloc(sizeof(uint8_t)*20000) != NULL || pressure_calls != 2)
+        err("\nОшибка: обработчик вызван повторно без нового достижения лимита. Тест %d не пройден\n", test_num);
+    if (_malloc(SIZE_MAX - 16384) != NULL || heap_last_error() != HEAP_ERR_LIMIT)
+        err("\nОшибка: переполнение при проверке жесткого лимита. Тест %d не пройден\n", test_num);
+
+    debug("\nВыделение сверх жесткого лимита с обработчиком, освобождающим память\n");
+    heap_add_pressure_callback(pressure_release, &arr);
+    heap_set_limits(16384, 32768);
+    uint8_t* arr2 = _malloc(sizeof(uint8_t)*20000);
+    if (arr2 == NULL || arr != NULL)
+        err("\nОшибка: выделение не повторено после обработки нехватки памяти. Тест %d не пройден\n", test_num);
+    debug_heap(stderr, heap);
+
+    debug("\nТест %d пройден\n\n", test_num);
+
+    heap_clear_pressure_callbacks();
+    heap_set_limits(0, 0);
+    _free(arr2);
+
+    heap_kill(heap, heap_mapped_bytes());
+}
+
+void lifetime_hint_test()
+{
+    static const uint16_t test_num = 11;
+    debug("Тест %d. Разделение короткоживущих и долгоживущих блоков по пулам\n", test_num);
+
+    void* heap = heap_init_test(HEAP_INIT_SIZE, test_num);
+
+    uint16_t* data = malloc_test(sizeof(uint16_t), test_num, heap, "uint16_t");
+
+    debug("\nВыделение короткоживущего массива uint8_t размера 1000. Пул короткоживущих блоков:\n");
+    uint8_t* buffer = _malloc_ex(sizeof(uint8_t)*1000, MEM_HINT_SHORT_LIVED);
+    struct block_header* short_pool = heap_pool_start(HEAP_POOL_SHORT);
+    if (buffer == NULL || short_pool == NULL || short_pool->contents != buffer)
+        err("\nОшибка: блок выделен не из пула короткоживущих блоков. Тест %d не пройден\n", test_num);
+    debug_heap(stderr, short_pool);
+
+    debug("\nВыделение долгоживущего массива uint32_t размера 100. Пул долгоживущих блоков:\n");
+    uint32_t* node = _malloc_ex(sizeof(uint32_t)*100, MEM_HINT_LONG_LIVED);
+    struct block_header* long_pool = heap_pool_start(HEAP_POOL_LONG);
+    if (node == NULL || long_pool == NULL || long_pool->contents != (uint8_t*) node)
+        err("\nОшибка: блок выделен не из пула долгоживущих блоков. Тест %d не пройден\n", test_num);
+    debug_heap(stderr, long_pool);
+
+    debug("\nОсновной пул:\n");
+    debug_heap(stderr, heap);
+
+    debug("\nТест %d пройден\n\n", test_num);
+
+    _free(node);
+    _free(buffer);
+    _free(data);
+
+    heap_kill(heap, HEAP_INIT_SIZE);
+    if (heap_pool_start(HEAP_POOL_SHORT) != NULL || heap_pool_start(HEAP_POOL_LONG) != NULL)
+        err("\nОшибка: пулы не удалены вместе с кучей. Тест %d не пройден\n", test_num);
+    if (_malloc_ex(sizeof(uint64_t), MEM_HINT_SHORT_LIVED) != NULL || heap_pool_start(HEAP_POOL_SHORT) != NULL)
+        err("\nОшибка: пул создан без инициализированной кучи. Тест %d не пройден\n", test_num);
+}
+
+/**
+ * @brief Проверка уплотнения пула перемещаемых блоков для теста
+ * @param[in] handles Дескрипторы, недействительные пропускаются
+ * @param[in] count Кол-во дескрипторов
+ * @param[in] test_num Номер теста
+*/
+static void compaction_check(hnd_t const* handles, size_t count, const uint16_t test_num)
+{
+    bool hole = false;
+    for (struct block_header const* b = heap_pool_start(HEAP_POOL_MOVABLE); b; b = b->next)
+    {
+        if (hole && !b->is_free)
+            err("\nОшибка: занятый блок остался за свободным. Тест %d не пройден\n", test_num);
+        hole = hole || b->is_free;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (hnd_is_invalid(handles[i]))
+            continue;
+        uint8_t* data = hnd_lock(handles[i]);
+        if ((uintptr_t) data % 16)
+            err("\nОшибка: данные перемещаемого блока не выровнены. Тест %d не пройден\n", test_num);
+        for (size_t j = 0; j < 100; ++j)
+            if (data[j] != (uint8_t) (i + 1))
+                err("\nОшибка: содержимое блока изменилось при перемещении. Тест %d не пройден\n", test_num);
+        hnd_unlock(handles[i]);
+    }
+}
+
+void handle_compaction_test()
+{
+    static const uint16_t test_num = 12;
+    debug("Тест %d. Уплотнение перемещаемых блоков, доступных по дескрипторам\n", test_num);
+
+    void* heap = heap_init_test(HEAP_INIT_SIZE, test_num);
+
+    debug("\nВыделение 24 перемещаемых массивов uint8_t размера от 100 до 123, освобождение каждого третьего. Пул перемещаемых блоков:\n");
+    hnd_t handles[24];
+    for (size_t i = 0; i < 24; ++i)
+    {
+        handles[i] = hnd_alloc(sizeof(uint8_t)*(100 + i));
+        if (hnd_is_invalid(handles[i]))
+            err("\nОшибка: Не удалось выделить перемещаемый блок. Тест %d не пройден\n", test_num);
+        memset(hnd_lock(handles[i]), (int) i + 1, 100);
+        hnd_unlock(handles[i]);
+    }
+    if (!hnd_is_invalid(hnd_alloc(SIZE_MAX - 4)))
+        err("\nОшибка: переполнение размера не обнаружено. Тест %d не пройден\n", test_num);
+    for (size_t i = 0; i < 24; i += 3)
+    {
+        hnd_free(handles[i]);
+        handles[i] = HND_INVALID;
+    }
+    struct block_header* movable_pool = heap_pool_start(HEAP_POOL_MOVABLE);
+    debug_heap(stderr, movable_pool);
+
+    debug("\nУплотнение одним шагом без ограничения времени. Результат:\n");
+    if (!hnd_compact_step(UINT64_MAX))
+        err("\nОшибка: уплотнение не завершено за один шаг. Тест %d не пройден\n", test_num);
+    debug_heap(stderr, movable_pool);
+    compaction_check(handles, 24, test_num);
+
+    debug("\nОсвобождение первого блока пула и уплотнение шагами с нулевым бюджетом времени. Результат:\n");
+    hnd_free(handles[1]);
+    handles[1] = HND_INVALID;
+    size_t steps = 1;
+    while (!hnd_compact_step(0))
+        if (++steps > 24)
+            err("\nОшибка: шаги уплотнения не продвигаются. Тест %d не пройден\n", test_num);
+    debug("Уплотнение завершено за %zu шага\n", steps);
+    debug_heap(stderr, movable_pool);
+    if (steps < 2)
+        err("\nОшибка: шаг с нулевым бюджетом не прервался. Тест %d не пройден\n", test_num);
+    compaction_check(handles, 24, test_num);
+
+    debug("\nТест %d пройден\n\n", test_num);
+
+    for (size_t i = 0; i < 24; ++i)
+        hnd_free(handles[i]);
+
+    heap_kill(heap, HEAP_INIT_SIZE);
+}
+
+/**
+ * @brief Проверка сводки свободных блоков основного пула для теста
+ * @param[in] test_num Номер теста
+ * @param[in] step Описание проверяемого шага
+*/
+static void index_check(const uint16_t test_num, const char* step)
+{
+    if (!heap_index_valid(HEAP_POOL_DEFAULT))
+        err("\nОшибка: сводка свободных блоков не совпадает с кучей после шага \"%s\". Тест %d не пройден\n", step, test_num);
+}
+
+void free_index_test()
+{
+    static const uint16_t test_num = 13;
+    debug("Тест %d. Согласованность сводки свободных блоков\n", test_num);
+
+    void* heap = heap_init_test(HEAP_INIT_SIZE, test_num);
+    index_check(test_num, "инициализация");
+
+    uint16_t* data = malloc_test(sizeof(uint16_t), test_num, heap, "uint16_t");
+    uint32_t* arr = malloc_test(sizeof(uint32_t)*100, test_num, heap, "массив uint32_t размера 100");
+    uint8_t* arr2 = malloc_test(sizeof(uint8_t)*100, test_num, heap, "массив uint8_t размера 100");
+    index_check(test_num, "деление блоков");
+
+    free_test(arr, heap, "массив uint32_t");
+    index_check(test_num, "освобождение без слияния");
+    free_test(data, heap, "uint16_t");
+    index_check(test_num, "слияние блоков");
+    free_test(arr2, heap, "массив uint8_t");
+    if (((struct block_header*) heap)->next != NULL)
+        err("\nОшибка: освобожденный блок не слит с предыдущим свободным блоком. Тест %d не пройден\n", test_num);
+    index_check(test_num, "слияние с предыдущим блоком");
+
+    struct block_header* tail = heap;
+    while (tail->next)
+        tail = tail->next;
+    uint8_t* rest = malloc_test(tail->capacity.bytes, test_num, heap, "остаток последнего блока");
+    if (rest != tail->contents || tail->is_free)
+        err("\nОшибка: последний блок кучи не занят целиком. Тест %d не пройден\n", test_num);
+    index_check(test_num, "выделение последнего блока целиком");
+
+    uint8_t* grown = malloc_test(sizeof(uint8_t)*20000, test_num, heap, "массив uint8_t размера 20000 (последний блок занят)");
+    struct block_header* grown_header = tail->next;
+    if (grown_header == NULL || grown != grown_header->contents)
+        err("\nОшибка: куча расширена не с последнего блока. Тест %d не пройден\n", test_num);
+    index_check(test_num, "расширение с занятого последнего блока");
+
+    tail = grown_header->next;
+    if (tail == NULL || !tail->is_free)
+        err("\nОшибка: после расширения нет свободного последнего блока. Тест %d не пройден\n", test_num);
+    uint8_t* merged = malloc_test(sizeof(uint8_t)*40000, test_num, heap, "массив uint8_t размера 40000 (последний блок свободен)");
+    if (merged != tail->contents)
+        err("\nОшибка: расширение не слито со свободным последним блоком. Тест %d не пройден\n", test_num);
+    index_check(test_num, "расширение со свободного последнего блока");
+
+    debug("\nТест %d пройден\n\n", test_num);
+
+    _free(merged);
+    _free(grown);
+    _free(rest);
+    index_check(test_num, "освобождение всех блоков");
+
+    heap_kill(heap, HEAP_INIT_SIZE);
+}
+
 static void* heap_init_test(size_t size, const uint16_t test_num)
 {
     debug("\nИнициализация кучи с размером %d. Результат:\n", HEAP_INIT_SIZE);
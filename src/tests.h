@@ -40,6 +40,46 @@ void extend_heap_test();
  * @param[in] heap Указатель на кучу
 */
 void continue_heap_test();
+
+/**
+ * @brief Тест на отложенное слияние свободных блоков при обслуживании кучи
+*/
+void deferred_merge_test();
+
+/**
+ * @brief Тест на выделение обнуленной памяти
+*/
+void calloc_test();
+
+/**
+ * @brief Тест на выделение выровненной памяти
+*/
+void aligned_alloc_test();
+
+/**
+ * @brief Тест на запись двоичного снимка кучи
+*/
+void snapshot_test();
+
+/**
+ * @brief Тест на мягкий и жесткий лимиты отображенной памяти
+*/
+void limits_test();
+
+/**
+ * @brief Тест на выделение памяти с подсказкой о времени жизни блока
+*/
+void lifetime_hint_test();
+
+/**
+ * @brief Тест на уплотнение перемещаемых блоков, доступных по дескрипторам
+*/
+void handle_compaction_test();
+
+/**
+ * @brief Тест на согласованность сводки свободных блоков при делении, слиянии и расширении кучи
+*/
+void free_index_test();
 /**@}*/
 
 #endif // !_TESTS_H_
\ No newline at end of file
@@ -14,6 +14,13 @@
 */
 inline size_t size_max( size_t x, size_t y ) { return (x >= y)? x : y ; }
 
+/**
+ * @brief Выбор минимального размера
+ * @param[in] x Первый размер
+ * @param[in] y Второй размер
+*/
+inline size_t size_min( size_t x, size_t y ) { return (x <= y)? x : y ; }
+
 /**
  * @brief Вывод сообщение об ошибке в stderr и прерывание программы
  * @param[in] msg Строка с сообщением
@@ -0,0 +1,154 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem_debug.h"
+#include "util.h"
+
+#define HISTOGRAM_BUCKETS 64 // Кол-во корзин гистограммы (по степеням двойки)
+
+
+/**
+ * @brief Статистика по снимку кучи
+*/
+struct heap_stat
+{
+  uint64_t used_blocks;                   /** Кол-во занятых блоков */
+  uint64_t used_bytes;                    /** Суммарная вместимость занятых блоков */
+  uint64_t free_runs;                     /** Кол-во непрерывных участков свободной памяти */
+  uint64_t free_bytes;                    /** Вместимость всех свободных участков */
+  uint64_t largest_run;                   /** Вместимость наибольшего свободного участка */
+  uint64_t histogram[HISTOGRAM_BUCKETS];  /** Распределение свободных участков по размерам */
+};
+
+/**
+ * @brief Чтение файла целиком
+ * @param[in] path Путь к файлу
+ * @param[out] size Размер прочитанных данных
+ * @return Указатель на буфер с содержимым файла
+*/
+static uint8_t* read_file( const char* path, size_t* size )
+{
+  FILE* f = fopen(path, "rb");
+  if (!f)
+    err("Не удалось открыть файл %s\n", path);
+  fseek(f, 0, SEEK_END);
+  const long end = ftell(f);
+  if (end < 0)
+    err("Не удалось прочитать файл %s\n", path);
+  *size = (size_t) end;
+  fseek(f, 0, SEEK_SET);
+
+  uint8_t* buf = malloc(*size);
+  if (!buf || fread(buf, 1, *size, f) != *size)
+    err("Не удалось прочитать файл %s\n", path);
+  fclose(f);
+  return buf;
+}
+
+/**
+ * @brief Проверка размеров снимка без переполнений
+ * @details Размер файла должен совпадать с заголовком, а сумма блоков по участкам - с общим кол-вом блоков
+ * @param[in] header Указатель на заголовок снимка
+ * @param[in] size Размер файла в байтах
+ * @return true, если снимок можно обходить, иначе false
+*/
+static bool snapshot_valid( const struct snapshot_header* header, size_t size )
+{
+  uint64_t regions_size, blocks_size, expected;
+  if (__builtin_mul_overflow(header->regions, sizeof(struct snapshot_region), &regions_size)
+      || __builtin_mul_overflow(header->blocks, sizeof(struct snapshot_block), &blocks_size)
+      || __builtin_add_overflow(regions_size, blocks_size, &expected)
+      || __builtin_add_overflow(expected, sizeof(*header), &expected)
+      || expected != size)
+    return false;
+
+  const struct snapshot_region* regions = (const struct snapshot_region*) (header + 1);
+  uint64_t blocks = 0;
+  for (uint64_t r = 0; r < header->regions; ++r)
+    if (__builtin_add_overflow(blocks, regions[r].blocks, &blocks))
+      return false;
+  return blocks == header->blocks;
+}
+
+/**
+ * @brief Учет свободного участка
+ * @param[out] stat Указатель на статистику
+ * @param[in] run Вместимость участка в байтах
+*/
+static void add_free_run( struct heap_stat* stat, uint64_t run )
+{
+  stat->free_runs++;
+  stat->free_bytes += run;
+  if (run > stat->largest_run)
+    stat->largest_run = run;
+  stat->histogram[run ? 63 - __builtin_clzll(run) : 0]++;
+}
+
+/**
+ * @brief Расчет статистики: соседние свободные блоки считаются одним участком, как после слияния
+ * @param[in] header Указатель на заголовок снимка
+ * @return Статистика
+*/
+static struct heap_stat collect( const struct snapshot_header* header )
+{
+  struct heap_stat stat = {0};
+  const struct snapshot_region* regions = (const struct snapshot_region*) (header + 1);
+  const struct snapshot_block* block = (const struct snapshot_block*) (regions + header->regions);
+
+  for (uint64_t r = 0; r < header->regions; ++r)
+  {
+    uint64_t run = 0;
+    bool in_run = false;
+    for (uint64_t i = 0; i < regions[r].blocks; ++i, ++block)
+    {
+      if (!block->is_free) // Занятый блок прерывает свободный участок
+      {
+        if (in_run)
+          add_free_run(&stat, run);
+        in_run = false;
+        stat.used_blocks++;
+        stat.used_bytes += block->capacity;
+        continue;
+      }
+      run = in_run ? run + header->header_size + block->capacity : block->capacity;
+      in_run = true;
+    }
+    if (in_run)
+      add_free_run(&stat, run);
+  }
+  return stat;
+}
+
+int main( int argc, char** argv )
+{
+  if (argc != 2)
+    err("Использование: %s <снимок кучи>\n", argv[0]);
+
+  size_t size;
+  uint8_t* buf = read_file(argv[1], &size);
+  const struct snapshot_header* header = (const struct snapshot_header*) buf;
+  if (size < sizeof(*header) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) || header->version != SNAPSHOT_VERSION)
+    err("Файл %s не является снимком кучи\n", argv[1]);
+  if (!snapshot_valid(header, size))
+    err("Снимок %s поврежден\n", argv[1]);
+
+  const struct heap_stat stat = collect(header);
+  const double fragmentation = stat.free_bytes ? 1.0 - (double) stat.largest_run / (double) stat.free_bytes : 0.0;
+
+  printf("Участков памяти:            %" PRIu64 "\n", header->regions);
+  printf("Блоков:                     %" PRIu64 "\n", header->blocks);
+  printf("Занято:                     %" PRIu64 " байт в %" PRIu64 " блоках\n", stat.used_bytes, stat.used_blocks);
+  printf("Свободно:                   %" PRIu64 " байт в %" PRIu64 " участках\n", stat.free_bytes, stat.free_runs);
+  printf("Наибольший выделяемый блок: %" PRIu64 " байт\n", stat.largest_run);
+  printf("Внешняя фрагментация:       %.4f\n", fragmentation);
+  printf("Распределение свободных участков:\n");
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    if (stat.histogram[i])
+      printf("  [%20" PRIu64 ", %20" PRIu64 ") %" PRIu64 "\n",
+             UINT64_C(1) << i, i < 63 ? UINT64_C(1) << (i + 1) : UINT64_MAX, stat.histogram[i]);
+
+  free(buf);
+  return 0;
+}